@@ -3505,7 +3505,16 @@ public:
                 if (const auto change = getPointFromQueue (paramQueue, numPoints - 1))
                 {
                     if (auto* param = comPluginInstance->getParamForVSTParamID (vstParamID))
+                    {
+                        if (auto* extensions = pluginInstance->getVST3ClientExtensions())
+                        {
+                            for (Steinberg::int32 point = 0; point < numPoints; ++point)
+                                if (const auto p = getPointFromQueue (paramQueue, point))
+                                    extensions->parameterPointReceived (param->getParameterIndex(), p->offsetSamples, (float) p->value);
+                        }
+
                         setValueAndNotifyIfChanged (*param, (float) change->value);
+                    }
                 }
             }
         }
@@ -3702,6 +3711,16 @@ private:
                     pluginInstance->processBlockBypassed (buffer, midiBuffer);
                 else
                     pluginInstance->processBlock (buffer, midiBuffer);
+
+                if (auto* extensions = pluginInstance->getVST3ClientExtensions())
+                {
+                    // hosts may reuse their ProcessData, so the flags are cleared as well
+                    for (Steinberg::int32 i = 0; i < data.numOutputs; ++i)
+                        data.outputs[i].silenceFlags = ! extensions->isOutputSilent ((int) i) ? 0
+                                                     : data.outputs[i].numChannels >= 64
+                                                         ? std::numeric_limits<Steinberg::uint64>::max()
+                                                         : ((Steinberg::uint64) 1 << data.outputs[i].numChannels) - 1;
+                }
             }
 
            #if JUCE_DEBUG && (! JucePlugin_ProducesMidiOutput)
@@ -105,6 +105,24 @@ struct VST3ClientExtensions
         is capable of replacing a given VST2.
     */
     virtual std::vector<String> getCompatibleClasses() const { return {}; }
+
+    /** This is called by the VST3 wrapper on the audio thread, before the
+        next processBlock(), for every automation point the host queued for
+        that block, in the order the host delivered them.
+
+        The last point of each parameter is still applied to the parameter
+        afterwards, so plug-ins which don't need sample accurate automation
+        can ignore this.
+    */
+    virtual void parameterPointReceived (int /*parameterIndex*/, int /*sampleOffset*/, float /*value*/) {}
+
+    /** This is called by the VST3 wrapper on the audio thread right after
+        processBlock(), once for each output bus. Return true when the block
+        that was just rendered is digital silence on that bus, the wrapper
+        then sets its silence flags so the host can skip processing further
+        down the chain, and clears them otherwise.
+    */
+    virtual bool isOutputSilent (int /*busIndex*/) const { return false; }
 };
 
 } // namespace juce
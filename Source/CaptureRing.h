@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** CaptureRing - keeps the latest samples of a stream
+ *
+ *  CaptureRing holds the last size() frames written to it.
+ *  The memory is allocated and locked into RAM up front, the
+ *  writer never blocks and never allocates, it overwrites the
+ *  oldest frames. That makes write() safe to call from the
+ *  audio thread.
+ *
+ *  A reader on any other thread copies the latest frames out.
+ *  The copy is verified against the write counter, so frames
+ *  which were overwritten while copying are never returned.
+ *
+ *  usage:
+ *      CaptureRing ring;
+ *      // while the audio thread is idle
+ *      ring.allocate(channels, frames);
+ *      // audio thread, once per block
+ *      ring.write(buffers, nframes);
+ *      // audio thread, when the stream changes its meaning
+ *      ring.clear();
+ *      // any other thread, keep margin frames away from the writer
+ *      size_t n = ring.read(dest, frames, margin);
+ *      // while the audio thread is idle
+ *      ring.release();
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+class CaptureRing
+{
+public:
+    CaptureRing() : nch(0), len(0), locked(false), written(0) {}
+    ~CaptureRing() { release(); }
+
+    // returns false when the memory couldn't be locked, the ring
+    // works anyway, it just may page on the audio thread
+    bool allocate(int channels, size_t frames) {
+        release();
+        if (channels <= 0 || !frames) return true;
+        // value initialized, so every page is touched before locking
+        data.reset(new float[channels * frames]());
+        nch = channels;
+        len = frames;
+#if defined(_WIN32)
+        locked = VirtualLock(data.get(), bytes()) != 0;
+#else
+        locked = mlock(data.get(), bytes()) == 0;
+#endif
+        written.store(0, std::memory_order_release);
+        return locked;
+    }
+
+    void release() {
+        if (locked) {
+#if defined(_WIN32)
+            VirtualUnlock(data.get(), bytes());
+#else
+            munlock(data.get(), bytes());
+#endif
+        }
+        locked = false;
+        data.reset();
+        nch = 0;
+        len = 0;
+        written.store(0, std::memory_order_release);
+    }
+
+    // forget the frames written so far, safe on the writer thread
+    void clear() { written.store(0, std::memory_order_release); }
+
+    size_t size() const { return len; }
+    int channels() const { return nch; }
+    bool isLocked() const { return locked; }
+    // frames written since allocate(), capped to size()
+    size_t available() const { return std::min<uint64_t>(written.load(std::memory_order_acquire), len); }
+
+    void write(const float* const* buf, int n) {
+        if (!len) return;
+        const uint64_t w = written.load(std::memory_order_relaxed);
+        size_t pos = w % len;
+        for (int o = 0; o < n;) {
+            const size_t l = std::min<size_t>(n - o, len - pos);
+            for (int c = 0; c < nch; c++)
+                memcpy(channel(c) + pos, buf[c] + o, l * sizeof(float));
+            pos = (pos + l) % len;
+            o += l;
+        }
+        written.store(w + n, std::memory_order_release);
+    }
+
+    // copy the latest frames, at most size()-margin, returns the number copied
+    size_t read(float* const* dest, size_t frames, size_t margin) const {
+        if (len <= margin) return 0;
+        for (int retry = 0; retry < 3; retry++) {
+            const uint64_t w = written.load(std::memory_order_acquire);
+            const size_t n = std::min<uint64_t>(std::min(frames, len - margin), w);
+            const uint64_t start = w - n;
+            size_t pos = start % len;
+            for (size_t o = 0; o < n;) {
+                const size_t l = std::min(n - o, len - pos);
+                for (int c = 0; c < nch; c++)
+                    memcpy(dest[c] + o, channel(c) + pos, l * sizeof(float));
+                pos = (pos + l) % len;
+                o += l;
+            }
+            // the writer may not have lapped the start of the copy
+            if (written.load(std::memory_order_acquire) - start <= len) return n;
+        }
+        return 0;
+    }
+
+private:
+    std::unique_ptr<float[]> data;
+    int nch;
+    size_t len;
+    bool locked;
+    std::atomic<uint64_t> written;
+
+    size_t bytes() const { return nch * len * sizeof(float); }
+    float *channel(int c) const { return data.get() + c * len; }
+};
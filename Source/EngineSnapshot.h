@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** EngineSnapshot - binary copy of the settings of a GxMachine
+ *
+ *  capture() stores the values of all savable parameters of a
+ *  machine in flat typed arrays, plus the mono and stereo rack
+ *  unit order. The parameter table is built on the first
+ *  capture and reused as long as the ParamIndex of the machine
+ *  keeps its generation, so a capture only copies values.
+ *  Loading or unloading a plugin rebuilds it.
+ *
+ *  restore() writes the values back into the same machine,
+ *  parameters which didn't change aren't touched. It refuses
+ *  when plugins were loaded or unloaded since the capture.
+ *
+ *  It replaces the saveState()/loadState() JSON round trip for
+ *  state which never leaves the process.
+ *
+ *  usage:
+ *      EngineSnapshot snap;
+ *      snap.capture(machine, index);
+ *      // ... Dsp::init() resets parameters
+ *      snap.restore(machine, index);
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "guitarix.h"
+#include "ParamIndex.h"
+
+class EngineSnapshot
+{
+public:
+    EngineSnapshot() : machine(nullptr), gen(0), valid(false) {}
+
+    bool empty() const { return !valid; }
+
+    // index follows the parameter map of m
+    void capture(gx_engine::GxMachine *m, const ParamIndex& index) {
+        if (m != machine || index.generation() != gen) build(m, index);
+        size_t ns = 0, nj = 0, nq = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            gx_engine::Parameter *p = entries[i].p;
+            switch (entries[i].kind) {
+            case k_float: values[i].f = p->getFloat().get_value(); break;
+            case k_int: values[i].i = p->getInt().get_value(); break;
+            case k_bool: values[i].i = p->getBool().get_value(); break;
+            case k_string: strings[ns++] = p->getString().get_value(); break;
+            case k_jconv: jconv[nj++] = dynamic_cast<gx_engine::JConvParameter*>(p)->get_value(); break;
+            case k_seq: seq[nq++] = dynamic_cast<gx_engine::SeqParameter*>(p)->get_value(); break;
+            }
+        }
+        for (int stereo = 0; stereo < 2; stereo++)
+            order[stereo] = m->get_settings().get_rack_unit_order(stereo);
+        valid = true;
+    }
+
+    // returns false when the snapshot doesn't belong to the machine
+    // or its parameters changed since the capture
+    bool restore(gx_engine::GxMachine *m, const ParamIndex& index) const {
+        if (!valid || m != machine || index.generation() != gen) return false;
+        size_t ns = 0, nj = 0, nq = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            gx_engine::Parameter *p = entries[i].p;
+            switch (entries[i].kind) {
+            case k_float:
+                if (p->getFloat().get_value() != values[i].f) p->getFloat().set(values[i].f);
+                break;
+            case k_int:
+                if (p->getInt().get_value() != values[i].i) p->getInt().set(values[i].i);
+                break;
+            case k_bool:
+                if (p->getBool().get_value() != (values[i].i != 0)) p->getBool().set(values[i].i != 0);
+                break;
+            case k_string: {
+                const std::string& s = strings[ns++];
+                if (p->getString().get_value().raw() != s) p->getString().set(s);
+                break;
+            }
+            case k_jconv: {
+                gx_engine::JConvParameter *pj = dynamic_cast<gx_engine::JConvParameter*>(p);
+                if (!(pj->get_value() == jconv[nj])) pj->set(jconv[nj]);
+                nj++;
+                break;
+            }
+            case k_seq: {
+                gx_engine::SeqParameter *pq = dynamic_cast<gx_engine::SeqParameter*>(p);
+                if (!(pq->get_value() == seq[nq])) pq->set(seq[nq]);
+                nq++;
+                break;
+            }
+            }
+        }
+        gx_preset::GxSettings& settings = m->get_settings();
+        for (int stereo = 0; stereo < 2; stereo++) {
+            const std::vector<std::string> current = settings.get_rack_unit_order(stereo);
+            if (current == order[stereo]) continue;
+            for (const auto& unit : current)
+                settings.remove_rack_unit(unit, stereo);
+            for (const auto& unit : order[stereo])
+                settings.insert_rack_unit(unit, "", stereo);
+        }
+        return true;
+    }
+
+private:
+    enum Kind { k_float, k_int, k_bool, k_string, k_jconv, k_seq };
+    struct Entry {
+        gx_engine::Parameter *p;
+        Kind kind;
+    };
+    union Value {
+        float f;
+        int i;
+    };
+
+    gx_engine::GxMachine *machine;
+    uint32_t gen;
+    bool valid;
+    std::vector<Entry> entries;
+    std::vector<Value> values;
+    std::vector<std::string> strings;
+    std::vector<gx_engine::GxJConvSettings> jconv;
+    std::vector<gx_engine::GxSeqSettings> seq;
+    std::vector<std::string> order[2];
+
+    void build(gx_engine::GxMachine *m, const ParamIndex& index) {
+        gx_engine::ParamMap& pmap = m->get_settings().get_param();
+        entries.clear();
+        size_t ns = 0, nj = 0, nq = 0;
+        for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
+            gx_engine::Parameter *p = i->second;
+            if (!p->isSavable() || p->isOutput()) continue;
+            if (p->isFloat()) entries.push_back({ p, k_float });
+            else if (p->isInt()) entries.push_back({ p, k_int });
+            else if (p->isBool()) entries.push_back({ p, k_bool });
+            else if (p->isString()) { entries.push_back({ p, k_string }); ns++; }
+            else if (dynamic_cast<gx_engine::JConvParameter*>(p)) { entries.push_back({ p, k_jconv }); nj++; }
+            else if (dynamic_cast<gx_engine::SeqParameter*>(p)) { entries.push_back({ p, k_seq }); nq++; }
+        }
+        values.assign(entries.size(), Value());
+        strings.assign(ns, std::string());
+        jconv.assign(nj, gx_engine::GxJConvSettings());
+        seq.assign(nq, gx_engine::GxSeqSettings());
+        machine = m;
+        gen = index.generation();
+        valid = false;
+    }
+};
@@ -21,6 +21,8 @@
 
 #include "guitarix.h"
 #include "gx_jack_wrapper.h"
+#include "ParamIndex.h"
+#include "JsonScan.h"
 
 #include "JuceUiBuilder.h"
 
@@ -36,17 +38,16 @@ GuitarixEditor::GuitarixEditor(GuitarixProcessor& p)
 	: AudioProcessorEditor(&p),
     audioProcessor(p),
     ed(p, false, MachineEditor::mn_Mono),
-    //ed_r(p, true, MachineEditor::mn_Mono),
     ed_s(p, false, MachineEditor::mn_Stereo),
-	monoButton("MONO"), stereoButton("STEREO"),
+    showRack2(true),
+	monoButton("MONO"), stereoButton("STEREO"), dualButton("DUAL"),
     pluginButton("LV2 plugs"), presetFileMenu(""),
     aboutButton("i"), tunerButton("TUNER"), onlineButton("Online"),
+    optionsButton("Options"),
     topBox(),
     ml(),
     new_bank(""),
     new_preset("")
-	//singleButton("SINGLE"), multiButton("DOUBLE"),
-	//mute1Button("MONO 1"), mute2Button("MONO 2"),
 {
 	audioProcessor.set_editor(this);
     
@@ -97,36 +98,17 @@ GuitarixEditor::GuitarixEditor(GuitarixProcessor& p)
     stereoButton.addListener(this);
     topBox.addAndMakeVisible(stereoButton);
 
+    dualButton.setComponentID("DUAL");
+    dualButton.setBounds(stereoButton.getRight()+4, 4, 20, texth);
+    dualButton.changeWidthToFitText();
+    dualButton.addListener(this);
+    topBox.addAndMakeVisible(dualButton);
+
     tunerButton.setComponentID("TUNER");
-    tunerButton.setBounds(stereoButton.getRight()+4, 4, 20, texth);
+    tunerButton.setBounds(dualButton.getRight()+4, 4, 20, texth);
     tunerButton.changeWidthToFitText();
     tunerButton.addListener(this);
     topBox.addAndMakeVisible(tunerButton);
-/*
-	singleButton.setComponentID("SINGLE");
-	singleButton.setBounds(stereoButton.getRight()+12, 4, 20, texth);
-	singleButton.changeWidthToFitText();
-	singleButton.addListener(this);
-	addAndMakeVisible(singleButton);
-
-	multiButton.setComponentID("DOUBLE");
-	multiButton.setBounds(singleButton.getRight(), 4, 20, texth);
-	multiButton.changeWidthToFitText();
-	multiButton.addListener(this);
-	addAndMakeVisible(multiButton);
-
-	mute1Button.setComponentID("MUTE1");
-	mute1Button.setBounds(stereoButton.getRight() + 12, 4, 20, texth);
-	mute1Button.changeWidthToFitText();
-	mute1Button.addListener(this);
-	addAndMakeVisible(mute1Button);
-
-	mute2Button.setComponentID("MUTE2");
-	mute2Button.setBounds(mute1Button.getRight(), 4, 20, texth);
-	mute2Button.changeWidthToFitText();
-	mute2Button.addListener(this);
-	addAndMakeVisible(mute2Button);
-*/
 	updateModeButtons();
     load_preset_list();
     presetFileMenu.onChange = [this] { on_preset_select(); };
@@ -146,12 +128,17 @@ GuitarixEditor::GuitarixEditor(GuitarixProcessor& p)
 	pluginButton.addListener(this);
 	topBox.addAndMakeVisible(pluginButton);
 
+	optionsButton.setComponentID("OPTIONS");
+	optionsButton.setBounds(pluginButton.getRight() + 8, 4, 20, texth);
+	optionsButton.changeWidthToFitText();
+	optionsButton.addListener(this);
+	topBox.addAndMakeVisible(optionsButton);
+
 	ed.setTopLeftPosition(0, texth+8); ed.setSize(edtw, winh);
-	//ed_r.setTopLeftPosition(edtw, texth); ed_r.setSize(edtw, winh);
 	ed_s.setTopLeftPosition(edtw+2, texth+8); ed_s.setSize(edtw, winh);
 	topBox.addAndMakeVisible(ed);
-	//addAndMakeVisible(ed_r);
 	topBox.addAndMakeVisible(ed_s);
+	updateRack2();
     
     startTimer(1, 42);
     startTimer(2, 200);
@@ -174,73 +161,103 @@ void GuitarixEditor::timerCallback(int id)
 {
     if (!audioProcessor.HasSampleRate()) return;
     if (id == 1) {
-        auto rms=audioProcessor.getRMSValues();
+        LevelMeter<4>::Snapshot m;
+        audioProcessor.getMeterSnapshot(m);
         for(int i=0; i<4; i++) {
-            meters[i].setLevel(rms[i].getCurrentValue());
+            // instant attack, fall back within 0.5 sec
+            const float l = Decibels::gainToDecibels(m.rms[i], -60.f);
+            if (l >= meterLevel[i]) meterLevel[i] = l;
+            else meterLevel[i] = jmax(l, meterLevel[i] - 66.f * 0.042f / 0.5f);
+            // keep the clip indicator for a second
+            if (m.clips[i] != meterClips[i]) {
+                meterClips[i] = m.clips[i];
+                meterClipTicks[i] = 24;
+            } else if (meterClipTicks[i]) {
+                meterClipTicks[i]--;
+            }
+            meters[i].setLevel(meterLevel[i]);
+            meters[i].setHold(Decibels::gainToDecibels(m.hold[i], -60.f));
+            meters[i].setClipped(meterClipTicks[i] > 0);
             meters[i].repaint();
         }
-        // monitor mono feedback controller
-        for (auto i = ed.clist.begin(); i != ed.clist.end(); ++i) {
-            std::string id = (*i);
-            if (machine->parameter_hasId(id)) {
-                if (machine->get_parameter_value<bool>(id.substr(0,id.find_last_of(".")+1)+"on_off")) {
-                    ed.on_param_value_changed(ed.get_parameter(id.c_str()));
-                }
-            }  
-        }
-        // monitor stere feedback controller
-        for (auto i = ed_s.clist.begin(); i != ed_s.clist.end(); ++i) {
-            std::string id = (*i);
-            if (machine->parameter_hasId(id)) {
-                if (machine->get_parameter_value<bool>(id.substr(0,id.find_last_of(".")+1)+"on_off")) {
-                    ed_s.on_param_value_changed(ed_s.get_parameter(id.c_str()));
-                }
-            }  
-        }
+        // monitor mono, rack 2 and stereo feedback controller
+        ed.update_feedback();
+        if (ed_r && ed_r->isVisible()) ed_r->update_feedback();
+        ed_s.update_feedback();
     } else {
-        bool stereo=audioProcessor.GetStereoMode();
-        if (machine->get_parameter_value<bool>("cab.on_off")) {
+        // the right machine is created on demand
+        gx_engine::GxMachine *machine_r;
+        audioProcessor.get_machine_jack(jack_r, machine_r, true);
+        bool stereo=audioProcessor.GetStereoMode() && jack_r;
+        // in dual mode rack 2 has units of its own
+        bool dual=!stereo && audioProcessor.GetMultiMode() && jack_r;
+        const ParamIndex& left = audioProcessor.params();
+        const ParamIndex& right = audioProcessor.params(true);
+        if (left.isOn("cab.on_off")) {
             jack->get_engine().cabinet.pl_check_update();
             if (stereo) jack_r->get_engine().cabinet.pl_check_update();
         }
-        if (machine->get_parameter_value<bool>("cab_st.on_off")) {
+        if (dual && right.isOn("cab.on_off")) {
+            jack_r->get_engine().cabinet.pl_check_update();
+        }
+        if (left.isOn("cab_st.on_off")) {
             jack->get_engine().cabinet_st.pl_check_update();
         }
-        if (machine->get_parameter_value<bool>("pre.on_off")) {
+        if (left.isOn("pre.on_off")) {
             jack->get_engine().preamp.pl_check_update();
             if (stereo) jack_r->get_engine().preamp.pl_check_update();
         }
-        if (machine->get_parameter_value<bool>("pre_st.on_off")) {
+        if (dual && right.isOn("pre.on_off")) {
+            jack_r->get_engine().preamp.pl_check_update();
+        }
+        if (left.isOn("pre_st.on_off")) {
             jack->get_engine().preamp_st.pl_check_update();
         }
-        if (machine->get_parameter_value<bool>("con.on_off")) {
+        if (left.isOn("con.on_off")) {
             jack->get_engine().contrast.pl_check_update();
             if (stereo) jack_r->get_engine().contrast.pl_check_update();
         }
+        if (dual && right.isOn("con.on_off")) {
+            jack_r->get_engine().contrast.pl_check_update();
+        }
     }
 }
 
 void GuitarixEditor::updateModeButtons()
 {
 	bool stereo=audioProcessor.GetStereoMode(), multi=audioProcessor.GetMultiMode();
-	bool mute1, mute2; audioProcessor.GetMonoMute(mute1, mute2);
     tuner_on = machine->get_parameter_value<bool>("system.show_tuner");
 
-	monoButton.setToggleState(!stereo, juce::dontSendNotification);
+	monoButton.setToggleState(!stereo && !multi, juce::dontSendNotification);
 	stereoButton.setToggleState(stereo, juce::dontSendNotification);
+	dualButton.setToggleState(multi && !stereo, juce::dontSendNotification);
     tunerButton.setToggleState(tuner_on, juce::dontSendNotification);
-    meters[1].setVisible(stereo);
-/*	singleButton.setToggleState(!multi, juce::dontSendNotification);
-	multiButton.setToggleState(multi, juce::dontSendNotification);
-	mute1Button.setToggleState(!mute1, juce::dontSendNotification);
-	mute2Button.setToggleState(!mute2, juce::dontSendNotification);
-*/
+    meters[1].setVisible(stereo || (multi && audioProcessor.GetDualInputs()));
+	updateRack2();
+}
+
+// in dual mode the right half shows rack 2 or the stereo rack
+void GuitarixEditor::updateRack2()
+{
+	const bool dual = audioProcessor.GetMultiMode() && !audioProcessor.GetStereoMode();
+	if (dual && !ed_r)
+	{
+		gx_engine::GxMachine *machine_r;
+		audioProcessor.get_machine_jack(jack_r, machine_r, true);
+		if (!jack_r) return;
+		ed_r = std::make_unique<MachineEditor>(audioProcessor, true, MachineEditor::mn_Mono);
+		ed_r->setTopLeftPosition(edtw+2, texth+8); ed_r->setSize(edtw, winh);
+		topBox.addChildComponent(*ed_r);
+	}
+	const bool rack2 = dual && showRack2 && ed_r;
+	if (ed_r) ed_r->setVisible(rack2);
+	ed_s.setVisible(!rack2);
 }
 
 void GuitarixEditor::createPluginEditors(bool l, bool r, bool s)
 {
 	if(l) ed.createPluginEditors();
-//	if(r) ed_r.createPluginEditors();
+	if(r && ed_r) ed_r->createPluginEditors();
 	if(s) ed_s.createPluginEditors();
 }
 
@@ -273,9 +290,11 @@ int GuitarixEditor::get_category(std::string cat_in) {
 void GuitarixEditor::buttonClicked(juce::Button * b)
 {
 	if (b == &monoButton)
-        {audioProcessor.SetStereoMode(false); updateModeButtons();}
+        {audioProcessor.SetMultiMode(false); audioProcessor.SetStereoMode(false); updateModeButtons();}
 	else if (b == &stereoButton)
-        {audioProcessor.SetStereoMode(true); updateModeButtons();}
+        {audioProcessor.SetMultiMode(false); audioProcessor.SetStereoMode(true); updateModeButtons();}
+	else if (b == &dualButton)
+        {audioProcessor.SetStereoMode(false); audioProcessor.SetMultiMode(true); updateModeButtons();}
 	else if (b == &tunerButton) {
         machine->set_parameter_value("system.show_tuner",!tuner_on);
         updateModeButtons();
@@ -360,21 +379,147 @@ void GuitarixEditor::buttonClicked(juce::Button * b)
             .withMaximumNumColumns(1),
              ModalCallbackFunction::forComponent (loadLV2PlugCallback, this));
     }
-/*	else if (b == &singleButton)
-		audioProcessor.SetMultiMode(false);
-	else if (b == &multiButton)
-		audioProcessor.SetMultiMode(true);
-	else if (b == &mute1Button || b == &mute2Button)
-	{
-		bool mute1, mute2; audioProcessor.GetMonoMute(mute1, mute2);
-		if (b == &mute1Button) mute1 = !mute1;
-		else mute2 = !mute2;
-		audioProcessor.SetMonoMute(mute1, mute2);
-	}*/
+    else if (b == &optionsButton) {
+        PopupMenu menu;
+        bool lowLatency = audioProcessor.GetLowLatency();
+        menu.addSectionHeader("Engine quantum");
+        menu.addItem (1, "Low latency", true, lowLatency);
+        menu.addItem (2, "Low CPU load", true, !lowLatency);
+        menu.addSectionHeader("Engine rate");
+        juce::String rate = "Internal rate 44.1/48 kHz";
+        if (audioProcessor.GetInternalRate() && audioProcessor.HasSampleRate())
+            rate << " (" << audioProcessor.GetEngineRate() << " Hz)";
+        menu.addItem (3, rate, true, audioProcessor.GetInternalRate());
+        menu.addSectionHeader("Compare");
+        menu.addItem (50, "Undo", audioProcessor.canUndo());
+        menu.addItem (51, "Redo", audioProcessor.canRedo());
+        menu.addItem (52, audioProcessor.compareSlot() ? "Switch to A" : "Switch to B");
+        addReampMenu(menu);
+        // the host parameter layout is fixed for an instance
+        const bool macros = GuitarixProcessor::getMacroPreference();
+        menu.addSectionHeader("Host parameters (new instances)");
+        menu.addItem (20, "All parameters", true, !macros);
+        menu.addItem (21, juce::String(int(GuitarixProcessor::macro_slots)) + " macro slots", true, macros);
+        if (audioProcessor.GetMultiMode() && !audioProcessor.GetStereoMode()) {
+            bool dualInputs = audioProcessor.GetDualInputs();
+            bool mute1, mute2; audioProcessor.GetMonoMute(mute1, mute2);
+            menu.addSectionHeader("Dual amp");
+            menu.addItem (10, "One guitar", true, !dualInputs);
+            menu.addItem (11, "Two inputs (L/R)", true, dualInputs);
+            menu.addItem (12, "Mute rack 1", true, mute1);
+            menu.addItem (13, "Mute rack 2", true, mute2);
+            menu.addItem (14, "Show rack 2", true, showRack2);
+            menu.addItem (15, "Show stereo rack", true, !showRack2);
+            for (int c = 0; c < 2; c++) {
+                float level, pan;
+                audioProcessor.GetDualMix(c, level, pan);
+                GuitarixProcessor *p = &audioProcessor;
+                juce::String n(c + 1);
+                menu.addCustomItem (0, std::make_unique<MenuSlider>("Level " + n, -40.0, 6.0, level,
+                    [p, c] (double v) { float l, a; p->GetDualMix(c, l, a); p->SetDualMix(c, float(v), a); }));
+                menu.addCustomItem (0, std::make_unique<MenuSlider>("Pan " + n, -1.0, 1.0, pan,
+                    [p, c] (double v) { float l, a; p->GetDualMix(c, l, a); p->SetDualMix(c, l, float(v)); }));
+            }
+        }
+        menu.showMenuAsync (PopupMenu::Options()
+            .withTargetComponent(&optionsButton)
+            .withMaximumNumColumns(1),
+             ModalCallbackFunction::forComponent (handleOptionsMenu, this));
+    }
 
 	updateModeButtons();
 }
 
+void GuitarixEditor::handleOptionsMenu(int choice, GuitarixEditor* ge)
+{
+    if (choice == 1 || choice == 2)
+        ge->audioProcessor.SetLowLatency(choice == 1);
+    else if (choice == 3)
+        ge->audioProcessor.SetInternalRate(!ge->audioProcessor.GetInternalRate());
+    else if (choice == 10 || choice == 11)
+        ge->audioProcessor.SetDualInputs(choice == 11);
+    else if (choice == 12 || choice == 13) {
+        bool mute1, mute2; ge->audioProcessor.GetMonoMute(mute1, mute2);
+        if (choice == 12) mute1 = !mute1;
+        else mute2 = !mute2;
+        ge->audioProcessor.SetMonoMute(mute1, mute2);
+    }
+    else if (choice == 14 || choice == 15)
+        ge->showRack2 = (choice == 14);
+    else if (choice == 20 || choice == 21)
+        GuitarixProcessor::setMacroPreference(choice == 21);
+    else if (choice >= 30 && choice <= 40)
+        ge->audioProcessor.SetCaptureMinutes(choice - 30);
+    else if (choice == 50)
+        ge->audioProcessor.undo();
+    else if (choice == 51)
+        ge->audioProcessor.redo();
+    else if (choice == 52)
+        ge->audioProcessor.switchCompare();
+    else if (choice >= reamp_item)
+        ge->on_reamp_select(choice);
+    ge->updateModeButtons();
+}
+
+// DI capture length and the presets to re-amp the capture with
+void GuitarixEditor::addReampMenu(juce::PopupMenu& menu)
+{
+    menu.addSectionHeader("DI capture");
+    PopupMenu length;
+    const int minutes = audioProcessor.GetCaptureMinutes();
+    for (int m : { 0, 1, 2, 5, 10 })
+        length.addItem (30 + m, m ? juce::String(m) + " min" : juce::String("Off"), true, m == minutes);
+    menu.addSubMenu ("Keep last", length);
+    if (minutes && !audioProcessor.isCaptureLocked())
+        menu.addItem (reamp_item - 2, "Not locked in RAM, may drop out", false);
+    if (minutes && !audioProcessor.captureActive())
+        menu.addItem (reamp_item - 3, "Paused in stereo and dual mode", false);
+    if (audioProcessor.isReamping()) {
+        menu.addItem (reamp_item - 1, "Rendering " + juce::String(int(audioProcessor.getReampProgress() * 100.f)) + "%", false);
+        return;
+    }
+    const int seconds = int(audioProcessor.getCaptureSeconds());
+    PopupMenu pr;
+    gx_system::PresetBanks* bb = banks();
+    int bi = 0;
+    if (bb)
+        for (auto b = bb->begin(); b != bb->end(); ++b, ++bi) {
+            gx_system::PresetFile* pp = presets(b->get_name());
+            if (!pp) continue;
+            PopupMenu sub;
+            int pi = 0;
+            for (auto p = pp->begin(); p != pp->end(); ++p)
+                sub.addItem (reamp_item + bi * 1000 + (pi++), p->name.raw());
+            pr.addSubMenu (b->get_name().raw(), sub);
+        }
+    menu.addSubMenu ("Re-amp last " + juce::String(seconds) + " s", pr, seconds > 0);
+}
+
+void GuitarixEditor::on_reamp_select(int choice)
+{
+    const int bi = (choice - reamp_item) / 1000, pi = (choice - reamp_item) % 1000;
+    gx_system::PresetBanks* bb = banks();
+    if (!bb) return;
+    auto b = bb->begin();
+    for (int i = 0; i < bi && b != bb->end(); i++) ++b;
+    if (b == bb->end()) return;
+    gx_system::PresetFile* pp = presets(b->get_name());
+    if (!pp || pi >= pp->size()) return;
+    std::string bank = b->get_name().raw();
+    std::string preset = pp->get_name(pi).raw();
+
+    auto fc = new juce::FileChooser ("Render the DI capture to...",
+        juce::File::getSpecialLocation(juce::File::userMusicDirectory).getChildFile(preset + ".wav"), "*.wav", false);
+    fc->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles |
+                     juce::FileBrowserComponent::warnAboutOverwriting,
+                                            [this, bank, preset, fc] (const juce::FileChooser& chooser) {
+        auto result = chooser.getResult();
+        if (result != juce::File())
+            audioProcessor.startReamp(bank, preset, result.withFileExtension("wav"));
+        delete fc;
+    });
+}
+
 void GuitarixEditor::loadLV2PlugCallback(int i, GuitarixEditor* ge)
 {
     if (!i) return;
@@ -396,6 +541,7 @@ void GuitarixEditor::loadLV2PlugCallback(int i, GuitarixEditor* ge)
     }
     ge->audioProcessor.update_plugin_list((*p)->active);
     ge->ed.on_rack_unit_changed(false);
+    if (ge->ed_r) ge->ed_r->on_rack_unit_changed(false);
     ge->ed_s.on_rack_unit_changed(true);
 }
 
@@ -516,40 +662,35 @@ void GuitarixEditor::on_preset_select()
     else on_preset_save();
 }
 
+// the catalog is scanned in place, only the kept values are copied
 void GuitarixEditor::read_online_preset_menu() {
-    ifstream is(audioProcessor.get_options()->get_online_config_filename());
     olp.clear();
-    gx_system::JsonParser jp(&is);
-    try {
-	jp.next(gx_system::JsonParser::begin_array);
-	do {
-	    std::string NAME_;
-	    std::string FILE_;
-	    std::string INFO_;
-	    std::string AUTHOR_;
-	    jp.next(gx_system::JsonParser::begin_object);
-	    do {
-		jp.next(gx_system::JsonParser::value_key);
-		if (jp.current_value() == "name") {
-		    jp.read_kv("name", NAME_);
-		} else if (jp.current_value() == "description") {
-		    jp.read_kv("description", INFO_);
-		} else if (jp.current_value() == "author") {
-		    jp.read_kv("author", AUTHOR_);
-		} else if (jp.current_value() == "file") {
-		    jp.read_kv("file", FILE_);
-		} else {
-		    jp.skip_object();
-		}
-	    } while (jp.peek() == gx_system::JsonParser::value_key);
-	    jp.next(gx_system::JsonParser::end_object);
-	    INFO_ += "Author : " + AUTHOR_;
-	    olp.push_back(std::tuple<std::string,std::string,std::string>(NAME_,FILE_,INFO_));
-	} while (jp.peek() == gx_system::JsonParser::begin_object);
-    } catch (gx_system::JsonException& e) {
-	cerr << "JsonException: " << e.what() << ": '" << jp.current_value() << "'" << endl;
-	assert(false);
+    juce::MemoryBlock data;
+    if (!juce::File(audioProcessor.get_options()->get_online_config_filename()).loadFileAsData(data)) return;
+    JsonScanner js(static_cast<const char*>(data.getData()), data.getSize());
+    if (js.next() != JsonScanner::begin_array) return;
+    while (js.peek() == JsonScanner::begin_object) {
+	js.next();
+	std::string NAME_;
+	std::string FILE_;
+	std::string INFO_;
+	std::string AUTHOR_;
+	while (js.next() == JsonScanner::value_key) {
+	    const std::string_view key = js.view();
+	    std::string *v = key == "name" ? &NAME_ : key == "description" ? &INFO_
+	                   : key == "author" ? &AUTHOR_ : key == "file" ? &FILE_ : nullptr;
+	    if (v && js.peek() == JsonScanner::value_string) {
+		js.next();
+		*v = js.string();
+	    } else if (!js.skip_value()) {
+		break;
+	    }
+	}
+	if (js.current() != JsonScanner::end_object) break;
+	INFO_ += "Author : " + AUTHOR_;
+	olp.push_back(std::tuple<std::string,std::string,std::string>(NAME_,FILE_,INFO_));
     }
+    if (js.failed()) cerr << "JsonException: " << audioProcessor.get_options()->get_online_config_filename() << endl;
 }
 
 void GuitarixEditor::downloadPreset(std::string uri) {
@@ -819,8 +960,7 @@ void MachineEditor::buildPluginCombo(juce::ComboBox *c, std::list<gx_engine::Plu
 			{
 				std::string s = pd->id;
 				std::string uid = "ui." + s;
-				gx_engine::ParamMap& pmap = settings->get_param();
-				if (pmap.hasId(uid))
+				if (get_parameter(uid.c_str()))
 				{
 					/*if (createHeading)
 					{
@@ -1127,20 +1267,30 @@ void MachineEditor::on_param_insert_remove(gx_engine::Parameter *p, bool inserte
 {
 	if (inserted) {
 		connect_value_changed_signal(p);
+	} else {
+		changed.erase(std::remove(changed.begin(), changed.end(), p), changed.end());
 	}
 }
 
 void MachineEditor::on_param_value_changed(gx_engine::Parameter *p)
 {
-	juce::MessageManager::callAsync(
-		[this, p]
-		{
-			for (auto i = editors.begin(); i != editors.end(); i++)
-				(*i)->on_param_value_changed(p); 
-			/*if (!mIgnoreRackUnitChange && p->id().substr(0, 3) == "ui.")
-				juce::MessageManager::callAsync([this] {createPluginEditors(); });*/
-		}
-	);
+	// the processor emits the change again on the message thread
+	if (GuitarixProcessor::signalsDeferred()) return;
+	// one drain per batch, a preset load changes hundreds of parameters
+	if (changed.empty())
+		juce::MessageManager::callAsync([this] { drainChanged(); });
+	changed.push_back(p);
+}
+
+void MachineEditor::drainChanged()
+{
+	std::vector<gx_engine::Parameter*> ps;
+	ps.swap(changed);
+	std::sort(ps.begin(), ps.end());
+	ps.erase(std::unique(ps.begin(), ps.end()), ps.end());
+	for (auto p : ps)
+		for (auto i = editors.begin(); i != editors.end(); i++)
+			(*i)->on_param_value_changed(p);
 }
 
 void MachineEditor::connect_value_changed_signal(gx_engine::Parameter *p) {
@@ -1267,11 +1417,24 @@ void MachineEditor::list(const char* id, std::list<gx_engine::Parameter*> &pars)
 }
 
 gx_engine::Parameter* MachineEditor::get_parameter(const char* pid) {
-	gx_engine::ParamMap& param = settings->get_param();
-	const Glib::ustring& id = pid;
-	if (param.hasId(id))
-		return &param[id];
-	return 0;
+	return audioProcessor.params(mRight).find(pid);
+}
+
+void MachineEditor::subscribe_timer(const std::string& id) {
+	ParamIndex& index = audioProcessor.params(mRight);
+	Feedback f { index.intern(id), index.intern(id.substr(0, id.find_last_of(".") + 1) + "on_off") };
+	for (const auto& c : clist)
+		if (c.id == f.id) return;
+	clist.push_back(f);
+}
+
+void MachineEditor::update_feedback() {
+	const ParamIndex& index = audioProcessor.params(mRight);
+	for (const auto& f : clist) {
+		gx_engine::Parameter *p = index.get(f.id);
+		gx_engine::Parameter *on_off = index.get(f.on_off);
+		if (p && on_off && on_off->isBool() && on_off->getBool().get_value()) on_param_value_changed(p);
+	}
 }
 
 //==============Get host provided context menu =========================
@@ -1285,7 +1448,31 @@ void MachineEditor::get_host_menu_for_parameter(juce::AudioProcessorParameter* p
 
 void MachineEditor::getParameterContext(const char* id) {
     juce::RangedAudioParameter* param = audioProcessor.findParamForID(id);
-    if (param) get_host_menu_for_parameter(param);
+    if (audioProcessor.isMacroMode() && audioProcessor.canBindMacro(id)) showMacroMenu(id, param);
+    else if (param) get_host_menu_for_parameter(param);
+}
+
+// learn or assign a macro slot, the host menu of a bound slot is a submenu
+void MachineEditor::showMacroMenu(const std::string& id, juce::AudioProcessorParameter* param) {
+    GuitarixProcessor *p = &audioProcessor;
+    const int bound = p->macroSlotOf(id.c_str());
+    juce::PopupMenu menu, assign;
+    for (int slot = 0; slot < GuitarixProcessor::macro_slots; slot++) {
+        juce::String n("Macro " + juce::String(slot + 1));
+        juce::String target = p->macroTarget(slot);
+        if (target.isNotEmpty()) n << " (" << target << ")";
+        assign.addItem(n, true, slot == bound, [p, slot, id] { p->bindMacro(slot, id.c_str()); });
+    }
+    menu.addSectionHeader("Macro");
+    menu.addItem("Learn", true, p->isLearning(id.c_str()), [p, id] { p->learnMacro(id.c_str()); });
+    menu.addSubMenu("Assign to", assign);
+    if (bound >= 0)
+        menu.addItem("Remove from Macro " + juce::String(bound + 1), [p, bound] { p->bindMacro(bound, nullptr); });
+    if (param && bound >= 0)
+        if (auto* c = audioProcessor.getEditor()->getHostContext())
+            if (auto menuInfo = c->getContextMenuForParameter (param))
+                menu.addSubMenu("Host", menuInfo->getEquivalentPopupMenu());
+    menu.showMenuAsync(juce::PopupMenu::Options{}.withTargetComponent(this).withMousePosition());
 }
 
 void MachineEditor::muteButtonContext(juce::ToggleButton *b, const char* id)
@@ -1293,8 +1480,7 @@ void MachineEditor::muteButtonContext(juce::ToggleButton *b, const char* id)
 	gx_engine::Plugin *pl = jack->get_engine().pluginlist.find_plugin(id);
 	if (!pl) return;
 
-	juce::RangedAudioParameter* param = audioProcessor.findParamForID(pl->id_on_off().c_str());
-    if (param) get_host_menu_for_parameter(param);
+	getParameterContext(pl->id_on_off().c_str());
 }
 
 void MachineEditor::presetFileMenuContext() {
@@ -38,10 +38,16 @@ public:
 	enum MonoT{ mn_Mono, mn_Stereo, mn_Both };
 	MachineEditor(GuitarixProcessor& p, bool right, MonoT mono);
     ~MachineEditor() override;
-    std::vector<std::string> clist;
+    // feedback controllers refreshed by the editor timer, as interned
+    // handles of the controller and of the on_off of its unit
+    struct Feedback { int id, on_off; };
+    std::vector<Feedback> clist;
+    void subscribe_timer(const std::string& id);
+    void update_feedback();
 
     void get_host_menu_for_parameter(juce::AudioProcessorParameter* param);
     void getParameterContext(const char* id);
+    void showMacroMenu(const std::string& id, juce::AudioProcessorParameter* param);
     //==============================================================================
 
 	void createPluginEditors();
@@ -81,6 +87,9 @@ private:
 	bool mIgnoreRackUnitChange;
 
 	void connect_value_changed_signal(gx_engine::Parameter *p);
+	// changed parameters, coalesced until the posted drain runs
+	std::vector<gx_engine::Parameter*> changed;
+	void drainChanged();
 	//
 	bool insert_rack_unit(const char* id, const char* before, bool stereo);
 	bool remove_rack_unit(const char* id, bool stereo);
@@ -118,14 +127,54 @@ public:
         
         const auto scaledX=juce::jmap(level,-60.f, +6.f, 0.f, bounds.getWidth());
         const auto scaledCol=juce::jmap(level,-60.f, 0.f, 0.5f, 1.0f);
-        g.setColour(juce::Colours::white.withBrightness(scaledCol));
-        g.fillRoundedRectangle(bounds.removeFromLeft(scaledX), 4.f);
+        g.setColour(clipped ? juce::Colours::red : juce::Colours::white.withBrightness(scaledCol));
+        g.fillRoundedRectangle(bounds.withWidth(scaledX), 4.f);
+
+        if (hold > -60.f) {
+            const auto holdX=juce::jmap(hold,-60.f, +6.f, 0.f, bounds.getWidth());
+            g.setColour(juce::Colours::white);
+            g.fillRect(bounds.withX(juce::jmax(0.f, holdX-1.f)).withWidth(1.f));
+        }
     }
     
     void setLevel(float value) {level=value;}
+    void setHold(float value) {hold=value;}
+    void setClipped(bool value) {clipped=value;}
 
 private:
     float level = -60.f;
+    float hold = -60.f;
+    bool clipped = false;
+};
+
+// a labelled slider in a popup menu, the menu stays open while it's dragged
+class MenuSlider: public juce::PopupMenu::CustomComponent
+{
+public:
+    MenuSlider(const juce::String& name, double min, double max, double value, std::function<void(double)> changed)
+        : juce::PopupMenu::CustomComponent(false), label(name)
+    {
+        slider.setSliderStyle(juce::Slider::LinearHorizontal);
+        slider.setTextBoxStyle(juce::Slider::TextBoxRight, false, 50, 20);
+        slider.setRange(min, max, 0.01);
+        slider.setValue(value, juce::dontSendNotification);
+        slider.setDoubleClickReturnValue(true, 0.0);
+        slider.onValueChange = [this, changed] { changed(slider.getValue()); };
+        addAndMakeVisible(slider);
+    }
+
+    void getIdealSize(int& w, int& h) override { w = 260; h = 24; }
+    void resized() override { slider.setBounds(getLocalBounds().withTrimmedLeft(70)); }
+    void paint(juce::Graphics& g) override
+    {
+        g.setColour(findColour(juce::PopupMenu::textColourId));
+        g.drawText(label, 8, 0, 62, getHeight(), juce::Justification::centredLeft);
+    }
+
+private:
+    juce::String label;
+    juce::Slider slider;
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MenuSlider)
 };
 
 class PresetSelect: public juce::ComboBox
@@ -167,24 +216,32 @@ public:
 	void updateModeButtons();
     void load_preset_list();
 
-	bool GetAlternateDouble() const { return ed.GetAlternateDouble()/* || ed_r.GetAlternateDouble()*/; }
+	bool GetAlternateDouble() const { return ed.GetAlternateDouble() || (ed_r && ed_r->GetAlternateDouble()); }
 
 private:
 	GuitarixProcessor& audioProcessor;
 
-	MachineEditor ed, /*ed_r, */ed_s;
+	MachineEditor ed, ed_s;
+	// rack 2 of dual mode, created once the right machine exists
+	std::unique_ptr<MachineEditor> ed_r;
+	bool showRack2;
+	void updateRack2();
     
     gx_jack::GxJack *jack;
 	gx_jack::GxJack *jack_r;
     gx_engine::GxMachine *machine;
     gx_preset::GxSettings *settings;
 
-	juce::TextButton monoButton, stereoButton, aboutButton, pluginButton, tunerButton , onlineButton /*, singleButton, multiButton, mute1Button, mute2Button*/;
+	juce::TextButton monoButton, stereoButton, dualButton, aboutButton, pluginButton, tunerButton , onlineButton, optionsButton;
 	void buttonClicked(juce::Button* b) override;
     bool tuner_on;
 
 	PresetSelect presetFileMenu;
     HorizontalMeter meters[4];
+    // meter ballistics live in the GUI, the processor only publishes raw levels
+    float meterLevel[4] = { -60.f, -60.f, -60.f, -60.f };
+    uint32_t meterClips[4] = { 0, 0, 0, 0 };
+    int meterClipTicks[4] = { 0, 0, 0, 0 };
     juce::Component topBox;
     gx_system::PresetFile* get_bank(const std::string& id);
     gx_system::PresetBanks* banks();
@@ -196,6 +253,10 @@ private:
     void on_preset_select();
     void on_online_preset();
     static void loadLV2PlugCallback(int i, GuitarixEditor* ge);
+    static void handleOptionsMenu(int choice, GuitarixEditor* ge);
+    enum { reamp_item = 100000 };
+    void addReampMenu(juce::PopupMenu& menu);
+    void on_reamp_select(int choice);
     bool cat_match(std::string cat_in, std::vector<std::string> to_match);
     int get_category(std::string cat_in);
     void downloadPreset(std::string uri);
@@ -19,6 +19,12 @@
 #include "GuitarixProcessor.h"
 #include "gx_jack_wrapper.h"
 #include "guitarix.h"       // NOLINT
+#include "gx_resampler.h"
+#include "EngineSnapshot.h"
+#include "StateChunk.h"
+#include "ParamIndex.h"
+#include "ViewStreamBuf.h"
+#include "ParamFrames.h"
 #include "GuitarixEditor.h"
 
 #ifdef _WINDOWS
@@ -45,6 +51,88 @@ struct ScopedHostParameterChange
     std::atomic<bool>& flag;
     const bool previous;
 };
+
+thread_local bool rtWriting = false;
+
+struct ScopedRTWrite
+{
+    ScopedRTWrite() : previous(rtWriting) { rtWriting = true; }
+    ~ScopedRTWrite() { rtWriting = previous; }
+    const bool previous;
+};
+
+// a value of an A/B or undo switch
+void writeValue(const ParamFrames::Write& w)
+{
+    switch (w.kind) {
+    case ParamFrames::k_float: w.p->getFloat().set(w.f); break;
+    case ParamFrames::k_int: w.p->getInt().set(w.i); break;
+    case ParamFrames::k_bool: w.p->getBool().set(w.i != 0); break;
+    default: break;
+    }
+}
+
+// fire the value signal of any parameter again
+void emitChanged(gx_engine::Parameter *p)
+{
+    if (p->isFloat())
+        p->getFloat().signal_changed()(p->getFloat().get_value());
+    else if (p->isInt())
+        p->getInt().signal_changed()(p->getInt().get_value());
+    else if (p->isBool())
+        p->getBool().signal_changed()(p->getBool().get_value());
+    else if (p->isString())
+        p->getString().signal_changed()(p->getString().get_value());
+    else if (auto pp = dynamic_cast<gx_engine::JConvParameter*>(p))
+        pp->signal_changed()(&pp->get_value());
+    else if (auto pp = dynamic_cast<gx_engine::SeqParameter*>(p))
+        pp->signal_changed()(&pp->get_value());
+}
+
+void emitValue(const ParamFrames::Write& w)
+{
+    switch (w.kind) {
+    case ParamFrames::k_float: w.p->getFloat().signal_changed()(w.p->getFloat().get_value()); break;
+    case ParamFrames::k_int: w.p->getInt().signal_changed()(w.p->getInt().get_value()); break;
+    case ParamFrames::k_bool: w.p->getBool().signal_changed()(w.p->getBool().get_value()); break;
+    default: break;
+    }
+}
+
+#ifndef _WINDOWS
+// per user settings of the plugin
+PropertiesFile::Options preferenceOptions()
+{
+	PropertiesFile::Options o;
+	o.applicationName = JucePlugin_Name;
+	o.commonToAllUsers = false;
+	o.osxLibrarySubFolder = "Preferences";
+	o.filenameSuffix = "xml";
+	return o;
+}
+#endif
+
+inline void setBit(std::atomic<uint32_t>* bits, int index)
+{
+    bits[index / 32].fetch_or(1u << (index % 32), std::memory_order_release);
+}
+
+// copy the value of a parameter to its twin in the other machine
+void copyValue(gx_engine::Parameter& p, gx_engine::Parameter& p1)
+{
+    if (p1.isFloat())
+        p1.getFloat().set(p.getFloat().get_value());
+    else if (p1.isInt())
+        p1.getInt().set(p.getInt().get_value());
+    else if (p1.isBool())
+        p1.getBool().set(p.getBool().get_value());
+    else if (p1.isString())
+        p1.getString().set(p.getString().get_value());
+    else if (auto pp1 = dynamic_cast<gx_engine::JConvParameter*>(&p1))
+        pp1->set(dynamic_cast<gx_engine::JConvParameter&>(p).get_value());
+    else if (auto pp1 = dynamic_cast<gx_engine::SeqParameter*>(&p1))
+        pp1->set(dynamic_cast<gx_engine::SeqParameter&>(p).get_value());
+}
 }
 
 static volatile int opt_counter=0;
@@ -67,12 +155,43 @@ GuitarixStart::GuitarixStart(int argc, char *argv[])
     gx_preset::GxSettings::check_settings_dir(*options, &need_new_preset);
     machine=new gx_engine::GxMachine(*options);
     jack = machine->get_jack();
+    machine_r = 0;
+    jack_r = 0;
+    gx_preset::GxSettings *settings = &(machine->get_settings());
+    gx_engine::ParamMap& pmap = settings->get_param();
+    gx_engine::ParamRegImpl preg(&pmap);
+    opt_counter++;
+}
+
+// the right machine is only needed for stereo input and dual mode,
+// so it's build on first use
+void GuitarixStart::create_machine_r()
+{
+    if (machine_r) return;
     machine_r=new gx_engine::GxMachine(*options);
     jack_r = machine_r->get_jack();
+    // point ParamRegImpl back to the left machine, like the constructor does
+    gx_preset::GxSettings *settings = &(machine->get_settings());
+    gx_engine::ParamMap& pmap = settings->get_param();
+    gx_engine::ParamRegImpl preg(&pmap);
+}
+
+gx_engine::GxMachine *GuitarixStart::create_render_machine()
+{
+    gx_engine::GxMachine *m = new gx_engine::GxMachine(*options);
+    gx_preset::GxSettings *settings = &(machine->get_settings());
+    gx_engine::ParamMap& pmap = settings->get_param();
+    gx_engine::ParamRegImpl preg(&pmap);
+    return m;
+}
+
+void GuitarixStart::delete_render_machine(gx_engine::GxMachine *m)
+{
+    delete m;
+    // reanimate the static ParamMap, like the destructor does
     gx_preset::GxSettings *settings = &(machine->get_settings());
     gx_engine::ParamMap& pmap = settings->get_param();
     gx_engine::ParamRegImpl preg(&pmap);
-    opt_counter++;
 }
 
 GuitarixStart::~GuitarixStart()
@@ -115,6 +234,85 @@ void GuitarixStart::gx_save_preset(gx_engine::GxMachine* machine, const char* ba
 
 extern void gx_inited();
 
+//==============================================================================
+// renders a DI capture through a private engine, as fast as the machine allows.
+// A second of silence lets ramps and convolvers settle, the output is shifted
+// by the engine latency so it lines up with the DI.
+static const int reamp_quantum = 256;
+
+class ReampRender : public juce::Thread
+{
+public:
+    ReampRender(gx_jack::GxJack *j, std::vector<float>&& d, int rate, int lat, const juce::File& f)
+        : juce::Thread("guitarix_reamp"), progress(0.f), ok(false), jack(j), di(std::move(d)),
+          sampleRate(rate), preroll(rate), latency(lat), target(f) {}
+    ~ReampRender() override { stopThread(10000); }
+
+    void run() override;
+    const juce::File& getTarget() const { return target; }
+
+    std::atomic<float> progress;
+    std::atomic<bool> ok;
+
+private:
+    gx_jack::GxJack *jack;
+    std::vector<float> di;
+    int sampleRate, preroll, latency;
+    juce::File target;
+};
+
+void ReampRender::run()
+{
+    gx_inited();
+    target.deleteFile();
+    std::unique_ptr<juce::FileOutputStream> fs(target.createOutputStream());
+    if (!fs) return;
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(fs.get(), sampleRate, 2, 24, {}, 0));
+    if (!writer) return;
+    fs.release(); // owned by the writer now
+
+    std::vector<float> in(reamp_quantum), l(reamp_quantum), r(reamp_quantum);
+    float *out[2] = { l.data(), r.data() };
+    const int64_t len = int64_t(di.size());
+    const int64_t first = preroll + latency;
+    const int64_t total = first + len;
+    int check = 0;
+    for (int64_t pos = 0; pos < total; pos += reamp_quantum)
+    {
+        if (threadShouldExit()) return;
+        for (int i = 0; i < reamp_quantum; i++)
+        {
+            const int64_t k = pos + i - preroll;
+            in[i] = (k >= 0 && k < len) ? di[k] : 0.f;
+        }
+        jack->process(reamp_quantum, in.data(), out);
+        jack->finish_process();
+
+        const int b = int(std::clamp<int64_t>(first - pos, 0, reamp_quantum));
+        const int e = int(std::clamp<int64_t>(total - pos, 0, reamp_quantum));
+        if (e > b)
+        {
+            const float *w[2] = { out[0] + b, out[1] + b };
+            writer->writeFromFloatArrays(w, 2, e - b);
+        }
+        // what the editor timer does for the live engines
+        if ((check += reamp_quantum) >= sampleRate / 10)
+        {
+            check = 0;
+            jack->get_engine().cabinet.pl_check_update();
+            jack->get_engine().cabinet_st.pl_check_update();
+            jack->get_engine().preamp.pl_check_update();
+            jack->get_engine().preamp_st.pl_check_update();
+            jack->get_engine().contrast.pl_check_update();
+        }
+        progress.store(float(pos) / total, std::memory_order_relaxed);
+    }
+    writer.reset();
+    progress.store(1.f, std::memory_order_relaxed);
+    ok.store(true, std::memory_order_release);
+}
+
 //==============================================================================
 GuitarixProcessor::GuitarixProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -124,24 +322,56 @@ GuitarixProcessor::GuitarixProcessor()
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
+                       .withOutput ("DI", juce::AudioChannelSet::stereo(), false)
+                       .withOutput ("Mono Rack Out", juce::AudioChannelSet::stereo(), false)
                      #endif
                        )
 #endif
 	, scale(1.0)
 	, mStereoMode(false)
 	, mMultiMode(false)
+	, mLowLatency(true)
+	, mInternalRate(false)
 	, mMono1Mute(false)
 	, mMono2Mute(false)
+	, mDualInputs(false)
 	, editor(0)
 	, currentPreset(-1)
 	, pgm_chg()
 	, bank_chg()
 	, mLoading(false)
     , buffersize(0)
+    , mDirect(false)
+    , qLowLatency(true)
+    , qNonRealtime(false)
+    , mRateDiv(1)
+    , nEvents(0)
+    , firstEvent(0)
+    , mInputPos(0)
+    , mEnginePos(0)
+    , mSleeping(false)
+    , mOutputSilent(false)
+    , mSilentFor(0)
+    , mQuietFor(0)
+    , mWakeRamp(0)
+    , mHostBypass(false)
+    , mBypassed(false)
+    , mBypassGain(0.f)
+    , mLinkGain(0.f)
+    , dryMask(0)
+    , dryPos(0)
+    , mDIBus(false)
+    , mTapBus(false)
+    , tapMask(0)
 	, mPresetsVisible(false)
+    , mCaptureMinutes(0.f)
+    , reamp_machine(0)
 {
     out[0]=out[1]=0;
     SampleRate = 0;
+    mDualLevel[0] = mDualLevel[1] = 0.f;
+    mDualPan[0] = mDualPan[1] = 0.f;
+    for (int i = 0; i < 4; i++) mDualGain[i] = 0.f;
     
 #ifdef _WINDOWS
 	static CHAR sModulePath[2048];
@@ -157,12 +387,7 @@ GuitarixProcessor::GuitarixProcessor()
 
 	File data = File::getSpecialLocation(File::SpecialLocationType::userApplicationDataDirectory);
 	defaultPath = data.getChildFile("Application Support/Guitarix/Presets/default.gxpreset");
-	PropertiesFile::Options o;
-	o.applicationName = JucePlugin_Name;
-	o.commonToAllUsers = false;
-	o.osxLibrarySubFolder = "Preferences";
-	o.filenameSuffix = "xml";
-	PropertiesFile f(o);
+	PropertiesFile f(preferenceOptions());
 	currentFile = f.getValue("LastPreset", defaultPath.getFullPathName());
 #endif
 
@@ -171,25 +396,22 @@ GuitarixProcessor::GuitarixProcessor()
     gx->check_config_dir();
     jack = gx->get_jack();
     machine = gx->get_machine();
-    jack_r = gx->get_jack_r();
-    machine_r = gx->get_machine_r();
+    jack_r = 0;
+    machine_r = 0;
 	//jack = gx_start(sizeof(argv) / sizeof(argv[0]), argv, machine);
 	//jack_r = gx_start(sizeof(argv) / sizeof(argv[0]), argv, machine_r);
 
 	options = gx->get_options();
 	jack->gx_jack_connection(true, true, 0, *options);
-	jack_r->gx_jack_connection(true, true, 0, *options);
 
 	//for resetting parameters in Dsp::init()
 	jack->buffersize_callback(512);
 	jack->srate_callback((int)22050);
-	jack_r->buffersize_callback(512);
-	jack_r->srate_callback((int)22050);
 
 	par_stereo = new AudioParameterBool(juce::ParameterID("stereo",1), "Stereo In", false);
 	par_stereo->addListener(this);
 	addParameter(par_stereo);
-    parameterMap.emplace(par_stereo->getParameterIndex(), par_stereo);
+    addHandle(par_stereo, nullptr);
 	gx_preset::GxSettings *settings = &(machine->get_settings());
 	gx_engine::ParamMap& pmap = settings->get_param();
     gx_engine::BoolParameter& mStereo = pmap.reg_par(
@@ -198,6 +420,34 @@ GuitarixProcessor::GuitarixProcessor()
 		sigc::bind(sigc::mem_fun(*this, &GuitarixProcessor::on_param_insert_remove), false));
     mStereo.signal_changed().connect(
         sigc::mem_fun(this, &GuitarixProcessor::SetStereoMode));
+    gx_engine::BoolParameter& mLatency = pmap.reg_par(
+      "engine.low_latency", N_("prefer low latency over low cpu load"), &mLowLatency, true, false)->getBool();
+    mLatency.signal_changed().connect(
+        sigc::hide(sigc::mem_fun(timer, &PluginUpdateTimer::update_prepare)));
+    gx_engine::BoolParameter& mRate = pmap.reg_par(
+      "engine.internal_rate", N_("run the racks at 44.1/48kHz on high session rates"), &mInternalRate, false, false)->getBool();
+    mRate.signal_changed().connect(
+        sigc::hide(sigc::mem_fun(timer, &PluginUpdateTimer::update_prepare)));
+    gx_engine::FloatParameter& mCapture = pmap.reg_par(
+      "engine.capture_minutes", N_("minutes of DI input kept for re-amping"), &mCaptureMinutes, 0.f, 0.f, 10.f, 1.f)->getFloat();
+    mCapture.signal_changed().connect(
+        sigc::hide(sigc::mem_fun(timer, &PluginUpdateTimer::update_prepare)));
+    gx_engine::BoolParameter& mDual = pmap.reg_par(
+      "engine.set_dual", N_("run two amp racks"), &mMultiMode, false, false)->getBool();
+    mDual.signal_changed().connect(
+        sigc::mem_fun(this, &GuitarixProcessor::SetMultiMode));
+    pmap.reg_par("engine.dual_inputs", N_("dual racks fed by left and right input"), &mDualInputs, false, false);
+    pmap.reg_par("engine.dual_mute1", N_("mute rack 1"), &mMono1Mute, false, false);
+    pmap.reg_par("engine.dual_mute2", N_("mute rack 2"), &mMono2Mute, false, false);
+    pmap.reg_par("engine.dual_level1", N_("rack 1 level"), &mDualLevel[0], 0.f, -40.f, 6.f, 0.1f);
+    pmap.reg_par("engine.dual_level2", N_("rack 2 level"), &mDualLevel[1], 0.f, -40.f, 6.f, 0.1f);
+    pmap.reg_par("engine.dual_pan1", N_("rack 1 pan"), &mDualPan[0], 0.f, -1.f, 1.f, 0.01f);
+    pmap.reg_par("engine.dual_pan2", N_("rack 2 pan"), &mDualPan[1], 0.f, -1.f, 1.f, 0.01f);
+	paramIndex[0].reset(new ParamIndex());
+	paramIndex[1].reset(new ParamIndex());
+	paramIndex[0]->attach(pmap);
+	findSyncUnits(false);
+	findResampledUnits(false);
 	for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
 		connect_value_changed_signal(i->second, false);
 	}
@@ -225,17 +475,43 @@ GuitarixProcessor::GuitarixProcessor()
     sel_preset = new juce::AudioParameterChoice(juce::ParameterID("selPreset",1), "Preset:Select", choices, 0);
 	sel_preset->addListener(this);
 	addParameter(sel_preset);
-    parameterMap.emplace(sel_preset->getParameterIndex(), sel_preset);
-
-	forwardParameters();
+    addHandle(sel_preset, nullptr);
+
+	mMacroMode = getMacroPreference();
+	if (mMacroMode) addMacroSlots();
+	else forwardParameters();
+	// added last to keep the indices of the forwarded parameters stable
+	par_bypass = new AudioParameterBool(juce::ParameterID("byps",1), "Bypass", false);
+	par_bypass->addListener(this);
+	addParameter(par_bypass);
+	addHandle(par_bypass, nullptr);
+	pendingEvents.reset(new std::atomic<int>[getParameters().size()]());
+	snapshot[0].reset(new EngineSnapshot());
+	snapshot[1].reset(new EngineSnapshot());
+	frames.reset(new ParamFrames());
+	nBitWords = (getParameters().size() + 31) / 32;
+	hostValues.reset(new std::atomic<float>[getParameters().size()]());
+	hostBits.reset(new std::atomic<uint32_t>[nBitWords]());
+	mSeenBlocks = 0;
+	mStalledTicks = 0;
 	timer.set_machine(machine, machine_r);
     timer.newProgram.store(0, std::memory_order_release);
     timer.oldProgram.store(0, std::memory_order_release);
 	timer.program_chg.connect(sigc::mem_fun(this, &GuitarixProcessor::setCurrentProgram));
 	timer.SetStereoMode.connect(sigc::mem_fun(this, &GuitarixProcessor::SetStereoMode));
+	timer.update_latency.connect(sigc::mem_fun(this, &GuitarixProcessor::updateLatency));
+	timer.reprepare.connect(sigc::mem_fun(this, &GuitarixProcessor::reprepare));
+	timer.create_right.connect(sigc::mem_fun(this, &GuitarixProcessor::ensureRight));
+	timer.reamp_check.connect(sigc::mem_fun(this, &GuitarixProcessor::checkReamp));
+	timer.flush_changes.connect(sigc::mem_fun(this, &GuitarixProcessor::flushChanges));
+	timer.flush_changes.connect(sigc::mem_fun(this, &GuitarixProcessor::checkStagedState));
+	timer.flush_changes.connect(sigc::mem_fun(this, &GuitarixProcessor::checkMacroLearn));
+	timer.flush_changes.connect(sigc::mem_fun(this, &GuitarixProcessor::checkFrameBatch));
+	timer.record_frame.connect(sigc::mem_fun(this, &GuitarixProcessor::recordFrame));
 
 	timer.startTimer(1,100);
 	timer.startTimer(2,1000);
+	timer.startTimer(3,40);
 }
 
 void PluginUpdateTimer::timerCallback(int id)
@@ -256,11 +532,26 @@ void PluginUpdateTimer::timerCallback(int id)
             mUpdateMode = false;
             if (editor) editor->updateModeButtons();
         }
+        if (mUpdateRight)
+        {
+            mUpdateRight = false;
+            create_right();
+        }
+        if (mUpdatePrepare)
+        {
+            mUpdatePrepare = false;
+            reprepare();
+        }
+        update_latency();
+        reamp_check();
+    } else if (id == 3) {
+        flush_changes();
     } else if (id == 2) {
         if(newProgram.load(std::memory_order_acquire) !=
                 oldProgram.load(std::memory_order_acquire)) {
             program_chg(newProgram.load(std::memory_order_acquire));
         }
+        record_frame();
     }
 }
 
@@ -269,12 +560,7 @@ GuitarixProcessor::~GuitarixProcessor()
 #ifdef _WINDOWS
 	WindowsRegistry::setValue("HKEY_CURRENT_USER\\Software\\Guitarix\\LastPreset", currentFile);
 #else
-	PropertiesFile::Options o;
-	o.applicationName = JucePlugin_Name;
-	o.commonToAllUsers = false;
-	o.osxLibrarySubFolder = "Preferences";
-	o.filenameSuffix = "xml";
-	PropertiesFile f(o);
+	PropertiesFile f(preferenceOptions());
 	f.setValue("LastPreset", currentFile);
 #endif
 	
@@ -282,81 +568,129 @@ GuitarixProcessor::~GuitarixProcessor()
     const ScopedLock lock (timer.timer_cs);
     timer.stopTimer(1);
     timer.stopTimer(2);
+    timer.stopTimer(3);
     }
     proc.stop();
-    delete out[0]; out[0]=0;
-    delete out[1]; out[1]=0;
+    restorePool.removeAllJobs(true, 1000);
+    reamp.reset();
+    if (reamp_machine) gx->delete_render_machine(reamp_machine);
+    delete[] out[0]; out[0]=0;
+    delete[] out[1]; out[1]=0;
     delete gx;
+    for (auto& b : slotBits) delete b.load(std::memory_order_acquire);
 }
 
 void GuitarixProcessor::compareParameters() {
-    gx_preset::GxSettings *settings = &(machine->get_settings());
-    gx_engine::ParamMap& pmap = settings->get_param();
-    for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
-        gx_engine::Parameter *p = i->second;
-        juce::RangedAudioParameter* para = findParamForID(p->id().c_str());
-        if (para) {
-            float val = para->getValue();
-            float newValue = 0.0;
-            if (p->isFloat()) {
-                newValue = (p->getFloat().get_value() -
-                    p->getLowerAsFloat()) / (p->getUpperAsFloat() - p->getLowerAsFloat());
-            } else if (p->isInt()) {
-                newValue = (float(p->getInt().get_value()) -
-                    p->getLowerAsFloat()) / (p->getUpperAsFloat() - p->getLowerAsFloat());
-            } else if (p->isBool()) {
-                newValue = float(p->getBool().get_value());
-            }
-            if (std::fabs(val - newValue) > 0.001) {
-                para->beginChangeGesture();
-                para->setValueNotifyingHost(newValue);
-                para->endChangeGesture();
-            }
-       }
+    mEchoing = true;
+    for (const auto& h : handles) {
+        if (!h.p.load(std::memory_order_relaxed)) continue;
+        float newValue = normalizedValue(h);
+        if (std::fabs(h.para->getValue() - newValue) > 0.001) {
+            h.para->beginChangeGesture();
+            h.para->setValueNotifyingHost(newValue);
+            h.para->endChangeGesture();
+        }
     }
+    mEchoing = false;
 }
 
 juce::RangedAudioParameter* GuitarixProcessor::findParamForID(const char *id) {
-    for (const auto& [key, param] : parameterMap) {
-        if (param->getParameterID() == id) return param;
+    auto i = handleOfId.find(id);
+    return i == handleOfId.end() ? nullptr : handles[i->second].para;
+}
+
+juce::RangedAudioParameter* GuitarixProcessor::findParamFor(const gx_engine::Parameter* p) const {
+    auto i = handleOfParam.find(p);
+    return i == handleOfParam.end() ? nullptr : handles[i->second].para;
+}
+
+void GuitarixProcessor::addHandle(juce::RangedAudioParameter* para, gx_engine::Parameter* p) {
+    const int index = para->getParameterIndex();
+    if (index >= int(handles.size())) handles.resize(index + 1);
+    ParamHandle& h = handles[index];
+    h.para = para;
+    handleOfId[para->getParameterID().toStdString()] = index;
+    if (p) bindHandle(index, p);
+}
+
+// the parameter is cleared before the range is written and set after it,
+// the audio thread skips handles without one and checks it again after
+// reading the range, see setEngineParameter()
+void GuitarixProcessor::bindHandle(int index, gx_engine::Parameter* p) {
+    ParamHandle& h = handles[index];
+    h.p.store(nullptr, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    h.kind.store(p->isFloat() ? ParamHandle::k_float : p->isInt() ? ParamHandle::k_int : ParamHandle::k_bool,
+                 std::memory_order_relaxed);
+    h.lower.store(p->getLowerAsFloat(), std::memory_order_relaxed);
+    h.range.store(p->getUpperAsFloat() - p->getLowerAsFloat(), std::memory_order_relaxed);
+    h.twin.store(findTwin(p), std::memory_order_relaxed);
+    h.p.store(p, std::memory_order_release);
+    handleOfParam[p] = index;
+    handleOfId[p->id()] = index;
+}
+
+void GuitarixProcessor::unbindHandle(int index) {
+    ParamHandle& h = handles[index];
+    if (gx_engine::Parameter *p = h.p.load(std::memory_order_relaxed)) handleOfParam.erase(p);
+    h.p.store(nullptr, std::memory_order_release);
+    h.twin.store(nullptr, std::memory_order_relaxed);
+    h.kind.store(ParamHandle::k_none, std::memory_order_relaxed);
+}
+
+// message thread
+float GuitarixProcessor::normalizedValue(const ParamHandle& h) {
+    gx_engine::Parameter *p = h.p.load(std::memory_order_relaxed);
+    const float lower = h.lower.load(std::memory_order_relaxed);
+    const float range = h.range.load(std::memory_order_relaxed);
+    switch (p ? h.kind.load(std::memory_order_relaxed) : ParamHandle::k_none) {
+    case ParamHandle::k_float: return (p->getFloat().get_value() - lower) / range;
+    case ParamHandle::k_int: return (float(p->getInt().get_value()) - lower) / range;
+    case ParamHandle::k_bool: return float(p->getBool().get_value());
+    default: return h.para->getValue();
     }
-    return nullptr;
 }
 
 static inline bool endswith(const std::string& s, int n, const char *t) {
     return s.compare(std::max<int>(0, s.size()-n), n, t) == 0;
 }
 
+// engine parameters which can be automated by the host
+bool GuitarixProcessor::isForwarded(gx_engine::Parameter *p) {
+    if (p->id().find("engine") != std::string::npos) return false;
+    else if (p->id().find("system") != std::string::npos) return false;
+    else if (endswith(p->id(), 3, ".pp")) return false;
+    else if (!p->isControllable() || !p->isSavable() || p->isOutput() || p->get_blocked()) return false;
+    return true;
+}
+
 void GuitarixProcessor::forwardParameters() {
     gx_preset::GxSettings *settings = &(machine->get_settings());
     gx_engine::ParamMap& pmap = settings->get_param();
     int a = 0;
     for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
         gx_engine::Parameter *p = i->second;
-        if (p->id().find("engine") != std::string::npos) continue;
-        else if (p->id().find("system") != std::string::npos) continue;
-        else if (endswith(p->id(), 3, ".pp")) continue;
-        else if (!p->isControllable() || !p->isSavable() || p->isOutput() || p->get_blocked()) continue;
+        if (!isForwarded(p)) continue;
         else if (p->isInt()) {
             juce::AudioParameterInt *b = new juce::AudioParameterInt(juce::ParameterID(p->id(),1), p->group() + ":" + p->name(),
                 p->getLowerAsFloat(), p->getUpperAsFloat(), p->getInt().get_value());
             b->addListener(this);
             addParameter(b);
-            parameterMap.emplace(b->getParameterIndex(), b);
+            addHandle(b, p);
             a++;
         } else if (p->isBool()) {
             juce::AudioParameterBool *b = new juce::AudioParameterBool(juce::ParameterID(p->id(),1),  p->group() + ":" + p->name(),
                 p->getBool().get_value());
             b->addListener(this);
             addParameter(b);
-            parameterMap.emplace(b->getParameterIndex(), b);
+            addHandle(b, p);
             a++;
         } else if (p->isFloat()) {
             juce::AudioParameterFloat *b = new juce::AudioParameterFloat(juce::ParameterID(p->id(),1),  p->group() + ":" + p->name(),
                 p->getLowerAsFloat(), p->getUpperAsFloat(), p->getFloat().get_value());
             b->addListener(this);
             addParameter(b);
-            parameterMap.emplace(b->getParameterIndex(), b);
+            addHandle(b, p);
             a++;
         } else if (p->isString()) {
             //fprintf(stderr, "string %s\n", i->first.c_str());
@@ -369,46 +703,433 @@ void GuitarixProcessor::forwardParameters() {
     //fprintf(stderr, "%i\n", a);
 }
 
+//==============================================================================
+// macro mode: a fixed bank of host parameters, each bound to one engine
+// parameter by learn or from the context menu of a control. The bindings
+// are part of the host state.
+
+bool GuitarixProcessor::getMacroPreference()
+{
+#ifdef _WINDOWS
+	return WindowsRegistry::getValue("HKEY_CURRENT_USER\\Software\\Guitarix\\MacroSlots", "0") == "1";
+#else
+	PropertiesFile f(preferenceOptions());
+	return f.getBoolValue("MacroSlots", false);
+#endif
+}
+
+void GuitarixProcessor::setMacroPreference(bool on)
+{
+#ifdef _WINDOWS
+	WindowsRegistry::setValue("HKEY_CURRENT_USER\\Software\\Guitarix\\MacroSlots", on ? "1" : "0");
+#else
+	PropertiesFile f(preferenceOptions());
+	f.setValue("MacroSlots", on);
+#endif
+}
+
+void GuitarixProcessor::addMacroSlots() {
+    firstMacro = getParameters().size();
+    macroIds.assign(macro_slots, std::string());
+    for (int slot = 0; slot < macro_slots; slot++) {
+        MacroParameter *m = new MacroParameter(slot + 1);
+        m->addListener(this);
+        addParameter(m);
+        addHandle(m, nullptr);
+    }
+}
+
+bool GuitarixProcessor::canBindMacro(const char *id) {
+    gx_engine::Parameter *p = paramIndex[0]->find(id);
+    if (!mMacroMode || !p) return false;
+    return isForwarded(p) && (p->isFloat() || p->isInt() || p->isBool());
+}
+
+int GuitarixProcessor::macroSlotOf(const char *id) const {
+    for (int slot = 0; slot < int(macroIds.size()); slot++)
+        if (macroIds[slot] == id) return slot;
+    return -1;
+}
+
+juce::String GuitarixProcessor::macroTarget(int slot) {
+    if (slot < 0 || slot >= int(macroIds.size()) || macroIds[slot].empty()) return juce::String();
+    gx_engine::Parameter *p = paramIndex[0]->find(macroIds[slot]);
+    if (!p) return juce::String::fromUTF8(macroIds[slot].c_str());
+    return juce::String::fromUTF8((p->group() + ":" + p->name()).c_str());
+}
+
+// binds a slot without telling the host, an empty id clears it.
+// Returns true when the slot changed.
+bool GuitarixProcessor::setMacro(int slot, const std::string& id) {
+    if (macroIds[slot] == id) return false;
+    const int index = firstMacro + slot;
+    ParamHandle& h = handles[index];
+    if (!macroIds[slot].empty()) {
+        unbindHandle(index);
+        handleOfId.erase(macroIds[slot]);
+        macroIds[slot].clear();
+    }
+    if (!id.empty()) {
+        // a parameter is bound to one slot at a time
+        const int old = macroSlotOf(id.c_str());
+        if (old >= 0) setMacro(old, std::string());
+        macroIds[slot] = id;
+        handleOfId[id] = index;
+        // parameters of plugins which aren't loaded are bound on insert
+        if (gx_engine::Parameter *p = paramIndex[0]->find(id)) bindHandle(index, p);
+    }
+    static_cast<MacroParameter*>(h.para)->setTarget(macroTarget(slot));
+    return true;
+}
+
+void GuitarixProcessor::bindMacro(int slot, const char *id) {
+    if (!mMacroMode || slot < 0 || slot >= macro_slots) return;
+    if (id && !canBindMacro(id)) return;
+    if (!setMacro(slot, id ? id : "")) return;
+    const ParamHandle& h = handles[firstMacro + slot];
+    // the slot takes the current value of the parameter
+    if (h.p.load(std::memory_order_relaxed)) {
+        mEchoing = true;
+        h.para->beginChangeGesture();
+        h.para->setValueNotifyingHost(normalizedValue(h));
+        h.para->endChangeGesture();
+        mEchoing = false;
+    }
+    updateHostDisplay(ChangeDetails().withParameterInfoChanged(true));
+}
+
+void GuitarixProcessor::applyMacros(const std::vector<std::string>& ids) {
+    if (!mMacroMode) return;
+    bool changed = false;
+    for (int slot = 0; slot < macro_slots; slot++)
+        changed = setMacro(slot, ids[slot]) || changed;
+    if (!changed) return;
+    compareParameters();
+    updateHostDisplay(ChangeDetails().withParameterInfoChanged(true));
+}
+
+// the host automation of a session saved in the other mode addresses
+// other parameters, tell the user once
+void GuitarixProcessor::checkMacroMode(bool macros) {
+    if (macros == mMacroMode || mMacroWarned) return;
+    mMacroWarned = true;
+    const juce::String msg = juce::String("This session was saved with ") +
+        (macros ? "macro slots" : "all parameters") + " as host parameters, this instance uses " +
+        (mMacroMode ? "macro slots" : "all parameters") + ". The automation of the session doesn't apply.\n"
+        "Switch \"Host parameters (new instances)\" in the menu and load the session again.";
+    juce::MessageManager::callAsync([msg] {
+        juce::AlertWindow::showAsync (MessageBoxOptions()
+                              .withIconType (MessageBoxIconType::WarningIcon)
+                              .withTitle ("Guitarix host parameters")
+                              .withMessage (msg)
+                              .withButton ("OK"),
+                            nullptr);
+    });
+}
+
+void GuitarixProcessor::learnMacro(const char *id) {
+    if (!canBindMacro(id)) return;
+    mLearnId = id;
+    mLearnedSlot.store(-1, std::memory_order_release);
+    mLearnArmed.store(true, std::memory_order_release);
+}
+
+// message thread, from the timer
+void GuitarixProcessor::checkMacroLearn() {
+    const int slot = mLearnedSlot.exchange(-1, std::memory_order_acq_rel);
+    if (slot < 0) return;
+    bindMacro(slot, mLearnId.c_str());
+    mLearnId.clear();
+}
+
 void GuitarixProcessor::parameterValueChanged(int parameterIndex, float newValue)
 {
-    auto ii = parameterMap.find (parameterIndex);
-    if (ii == parameterMap.end()) return; // parameter is not in list
-    auto* parameter = ii->second;
-    if (parameter->getParameterID() == "stereo") mStereoMode = newValue > 0.5;
-    else if (parameter->getParameterID() == "byps") return; // not implemented
-    else if (parameter->getParameterID() == "selPreset")
+    const ParamHandle* h = findHandle(parameterIndex);
+    if (!h || !h->para) return; // parameter is not in list
+    if (h->para == par_stereo) {
+        mStereoMode = newValue > 0.5;
+        if (mStereoMode && !mRightReady.load(std::memory_order_acquire)) timer.update_right();
+    }
+    else if (h->para == par_bypass) {
+        mBypass.store(newValue > 0.5, std::memory_order_release);
+        return;
+    }
+    else if (h->para == sel_preset)
         timer.newProgram.store(int(newValue * presets.size()), std::memory_order_release);
     else {
-        ScopedHostParameterChange applyingHostParameterChange(mApplyingHostParameterChange);
-        gx_preset::GxSettings *settings = &(machine->get_settings());
-        gx_engine::ParamMap& param = settings->get_param();
-        gx_engine::Parameter& p1 = param[parameter->getParameterID().toStdString()];
-        if (&p1) {
-            if (p1.isFloat())
-                p1.getFloat().set(p1.getLowerAsFloat() +(newValue * (p1.getUpperAsFloat() - p1.getLowerAsFloat())));
-            else if (p1.isInt())
-                p1.getInt().set(int(p1.getLowerAsFloat() +(newValue * (p1.getUpperAsFloat() - p1.getLowerAsFloat()))));
-            else if (p1.isBool())
-                p1.getBool().set(newValue > 0.5);
-            //on_param_value_changed(&p1, false);
+        // a macro slot moved by the host while a learn is armed
+        // and is bound to the parameter instead of moving the old one
+        if (isMacroIndex(parameterIndex) && !mEchoing && mLearnArmed.exchange(false, std::memory_order_acq_rel)) {
+            mLearnedSlot.store(parameterIndex - firstMacro, std::memory_order_release);
+            return;
         }
+        // a queued automation point of this block will set the engine value
+        if (pendingEvents && pendingEvents[parameterIndex].load(std::memory_order_relaxed)) return;
+        pushHostValue(parameterIndex, newValue);
     }
     timer.update_mode();
 }
 
+void GuitarixProcessor::pushHostValue(int index, float value)
+{
+    if (!hostBits) return;
+    hostValues[index].store(value, std::memory_order_relaxed);
+    setBit(hostBits.get(), index);
+}
+
+// audio thread, at the start of each block
+void GuitarixProcessor::applyHostValues()
+{
+    if (!hostBits) return;
+    // the timer took over while there were no process calls,
+    // the values stay flagged for the next block
+    if (mApplyingHostValues.exchange(true, std::memory_order_acquire)) return;
+    ScopedRTWrite rtWrite;
+    bool changed = false;
+    for (int w = 0; w < nBitWords; w++) {
+        uint32_t bits = hostBits[w].exchange(0, std::memory_order_acquire);
+        for (int index = w * 32; bits; index++, bits >>= 1) {
+            if (!(bits & 1)) continue;
+            // a queued automation point of this block will set the engine value
+            if (pendingEvents[index].load(std::memory_order_relaxed)) continue;
+            setEngineParameter(index, hostValues[index].load(std::memory_order_relaxed));
+            changed = true;
+        }
+    }
+    mApplyingHostValues.store(false, std::memory_order_release);
+    if (changed && !isNonRealtime()) timer.update_mode();
+}
+
+// message thread, emits the signals the audio thread held back and
+// forwards the changes marked since the last tick
+void GuitarixProcessor::flushChanges()
+{
+    // without process calls (plugin deactivated) the values are applied here
+    const uint32_t blocks = mBlockCount.load(std::memory_order_relaxed);
+    if (blocks != mSeenBlocks) {
+        mSeenBlocks = blocks;
+        mStalledTicks = 0;
+    } else if (++mStalledTicks > 5) {
+        applyHostValues();
+    }
+    emitDeferred();
+    // forward the final values of the marked slots, a mirrored value marks
+    // the slot of the other machine, which is passed on in the same tick
+    for (int pass = 0; pass < 2 && !dirtySlots.empty(); pass++) {
+        drainSlots.swap(dirtySlots);
+        if (!++mChangeEpoch) mChangeEpoch = 1;
+        for (int slot : drainSlots)
+            if (changeSlots[slot].p) forwardChange(changeSlots[slot]);
+        drainSlots.clear();
+    }
+}
+
+bool GuitarixProcessor::signalsDeferred()
+{
+    return rtWriting || !juce::MessageManager::existsAndIsCurrentThread();
+}
+
+// any thread, only touches the bit block of the slot. The loud bit is
+// set first, the reader clears it for the slots it takes.
+void GuitarixProcessor::deferChange(int slot, bool loud)
+{
+    if (slot >= slot_block * slot_blocks) return;
+    SlotBits *b = slotBits[slot / slot_block].load(std::memory_order_acquire);
+    if (!b) return;
+    if (loud) setBit(b->loud, slot % slot_block);
+    setBit(b->defer, slot % slot_block);
+}
+
+void GuitarixProcessor::emitDeferred()
+{
+    for (int k = 0; k < slot_blocks; k++) {
+        SlotBits *b = slotBits[k].load(std::memory_order_acquire);
+        if (!b) break;
+        for (int w = 0; w < slot_block / 32; w++) {
+            uint32_t bits = b->defer[w].exchange(0, std::memory_order_acquire);
+            if (!bits) continue;
+            uint32_t loud = b->loud[w].fetch_and(~bits, std::memory_order_acq_rel) & bits;
+            for (int slot = k * slot_block + w * 32; bits; slot++, bits >>= 1, loud >>= 1) {
+                if (!(bits & 1) || !changeSlots[slot].p) continue;
+                if (loud & 1) {
+                    emitChanged(changeSlots[slot].p);
+                } else {
+                    // the value came from the host, don't echo it back
+                    ScopedHostParameterChange applyingHostParameterChange(mApplyingHostParameterChange);
+                    emitChanged(changeSlots[slot].p);
+                }
+            }
+        }
+    }
+}
+
+static void setNormalized(gx_engine::Parameter *p, int kind, float lower, float range, float newValue)
+{
+    switch (kind) {
+    case ParamHandle::k_float: p->getFloat().set(lower + newValue * range); break;
+    case ParamHandle::k_int: p->getInt().set(int(lower + newValue * range)); break;
+    case ParamHandle::k_bool: p->getBool().set(newValue > 0.5); break;
+    default: break;
+    }
+}
+
+void GuitarixProcessor::setEngineParameter(int index, float newValue)
+{
+    const ParamHandle* h = findHandle(index);
+    if (!h) return;
+    gx_engine::Parameter *p = h->p.load(std::memory_order_acquire);
+    if (!p) return; // wrapper parameter, or the engine parameter is gone
+    const int kind = h->kind.load(std::memory_order_relaxed);
+    const float lower = h->lower.load(std::memory_order_relaxed);
+    const float range = h->range.load(std::memory_order_relaxed);
+    gx_engine::Parameter *twin = h->twin.load(std::memory_order_relaxed);
+    // rebound meanwhile, the range may belong to another parameter
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->p.load(std::memory_order_relaxed) != p) return;
+    setNormalized(p, kind, lower, range, newValue);
+    // the right machine mirrors the left one in the same block,
+    // unless the racks are independent
+    if (twin && !dualActive()) setNormalized(twin, kind, lower, range, newValue);
+}
+
+// called by the VST3 wrapper for each automation point of the coming block,
+// before the last point of the queue is passed to parameterValueChanged()
+void GuitarixProcessor::parameterPointReceived(int parameterIndex, int sampleOffset, float value)
+{
+    if (parameterIndex == par_stereo->getParameterIndex() ||
+        parameterIndex == par_bypass->getParameterIndex() ||
+        parameterIndex == sel_preset->getParameterIndex()) return;
+    const ParamHandle* h = findHandle(parameterIndex);
+    if (!h || !h->p.load(std::memory_order_acquire)) return; // parameter is not in list
+    ParamEvent ev { mInputPos + sampleOffset, parameterIndex, value };
+    if (nEvents == max_events) {
+        // list is full, the point replaces the last queued one of the
+        // parameter, an older point must not be applied after it
+        int j = nEvents - 1;
+        while (j >= firstEvent && events[j].index != parameterIndex) j--;
+        if (j < firstEvent) {
+            // nothing queued, fall back to block accuracy
+            pushHostValue(parameterIndex, value);
+            return;
+        }
+        for (; j + 1 < nEvents && events[j+1].time <= ev.time; j++)
+            events[j] = events[j+1];
+        events[j] = ev;
+        return;
+    }
+    // points arrive grouped by parameter, keep the list sorted by time
+    int i = nEvents++;
+    for (; i > firstEvent && events[i-1].time > ev.time; i--)
+        events[i] = events[i-1];
+    events[i] = ev;
+    pendingEvents[parameterIndex].fetch_add(1, std::memory_order_relaxed);
+}
+
+void GuitarixProcessor::applyEvents(int64_t until)
+{
+    ScopedRTWrite rtWrite;
+    bool changed = false;
+    while (firstEvent < nEvents && events[firstEvent].time < until) {
+        const ParamEvent& ev = events[firstEvent++];
+        pendingEvents[ev.index].fetch_sub(1, std::memory_order_relaxed);
+        setEngineParameter(ev.index, ev.value);
+        changed = true;
+    }
+    if (changed && !isNonRealtime()) timer.update_mode();
+}
+
+// the convolvers are part of the engine, their parameters live as long as the machine
+static const char *sync_units[] = {
+    "cab.on_off", "cab_st.on_off", "pre.on_off", "pre_st.on_off",
+    "con.on_off", "jconv.on_off", "jconv_mono.on_off",
+};
+
+void GuitarixProcessor::findSyncUnits(bool right)
+{
+    syncUnits[right].clear();
+    for (auto u : sync_units)
+        if (gx_engine::Parameter *p = paramIndex[right]->find(u))
+            if (p->isBool()) syncUnits[right].push_back(p);
+}
+
+// audio thread
+bool GuitarixProcessor::splitEvents() const
+{
+    for (auto p : syncUnits[0])
+        if (p->getBool().get_value()) return false;
+    if (dualActive())
+        for (auto p : syncUnits[1])
+            if (p->getBool().get_value()) return false;
+    return true;
+}
+
+void GuitarixProcessor::compactEvents()
+{
+    if (firstEvent == nEvents) {
+        firstEvent = nEvents = 0;
+    } else if (firstEvent) {
+        std::copy(events.begin()+firstEvent, events.begin()+nEvents, events.begin());
+        nEvents -= firstEvent;
+        firstEvent = 0;
+    }
+}
+
 void GuitarixProcessor::SetStereoMode(bool on)
 {
+	if (on && !mRightReady.load(std::memory_order_acquire)) {
+		if (juce::MessageManager::existsAndIsCurrentThread()) ensureRight();
+		else timer.update_right();
+	}
 	mStereoMode = on;
 	*par_stereo = on;
 }
 
+void GuitarixProcessor::SetMultiMode(bool on)
+{
+	if (on && !mRightReady.load(std::memory_order_acquire)) {
+		if (juce::MessageManager::existsAndIsCurrentThread()) ensureRight();
+		else timer.update_right();
+	}
+	// leaving dual mode, the right machine is a mirror of the left one again
+	if (!on && !mLoading) cloneSettingsToMachineR();
+	mMultiMode = on;
+	timer.update_mode();
+}
+
 //==============================================================================
 
+void GuitarixProcessor::ensureRight()
+{
+    if (mRightReady.load(std::memory_order_acquire)) return;
+    gx->create_machine_r();
+    machine_r = gx->get_machine_r();
+    jack_r = gx->get_jack_r();
+    jack_r->gx_jack_connection(true, true, 0, *options);
+    //for resetting parameters in Dsp::init()
+    jack_r->buffersize_callback(SampleRate ? quantum / mRateDiv : 512);
+    jack_r->srate_callback(SampleRate ? SampleRate / mRateDiv : 22050);
+    paramIndex[1]->attach(machine_r->get_settings().get_param());
+    findSyncUnits(true);
+    findResampledUnits(true);
+    gx_engine::ParamMap& pmap_r = machine_r->get_settings().get_param();
+    pmap_r.signal_insert_remove().connect(
+        sigc::bind(sigc::mem_fun(*this, &GuitarixProcessor::on_param_insert_remove), true));
+    // changes of the right machine are mirrored to the left one as well
+    for (gx_engine::ParamMap::iterator i = pmap_r.begin(); i != pmap_r.end(); ++i)
+        connect_value_changed_signal(i->second, true);
+    pairSlots();
+    cloneSettingsToMachineR();
+    loadPendingRight();
+    jack_r->get_engine().set_rack_changed();
+    timer.set_machine(machine, machine_r);
+    mRightReady.store(true, std::memory_order_release);
+}
+
 void GuitarixProcessor::update_plugin_list(bool add)
 {
     machine->save_ladspalist(editor->ml);
     jack->get_engine().ladspaloader_update_plugins();
-    if (add) {
+    if (add && machine_r) {
        machine_r->save_ladspalist(editor->ml);
         jack_r->get_engine().ladspaloader_update_plugins();
     }
@@ -418,72 +1139,111 @@ void GuitarixProcessor::on_param_insert_remove(gx_engine::Parameter *p, bool ins
 {
 	if (inserted) {
 		connect_value_changed_signal(p, right);
+	} else {
+		// the A/B and undo batches hold parameters of the left machine
+		if (!right) dropFrameBatch();
+		auto s = slotOf.find(p);
+		if (s != slotOf.end()) {
+			changeSlots[s->second].p = nullptr;
+			freeSlots.push_back(s->second);
+			slotOf.erase(s);
+		}
+	}
+	// plugins are loaded and unloaded in both machines, keep the twins valid
+	gx_engine::Parameter *other = right ? paramIndex[0]->find(p->id()) : findTwin(p);
+	if (other) {
+		auto s = slotOf.find(other);
+		if (s != slotOf.end()) changeSlots[s->second].twin = inserted ? p : nullptr;
+	}
+	if (right) {
+		// the handles are bound to the left machine
+		if (!other) return;
+		auto i = handleOfParam.find(other);
+		if (i != handleOfParam.end()) handles[i->second].twin.store(inserted ? p : nullptr, std::memory_order_release);
+		return;
+	}
+	// keep the handles of plugins which are unloaded and loaded again valid
+	if (inserted) {
+		auto i = handleOfId.find(p->id());
+		if (i != handleOfId.end() && !handles[i->second].p.load(std::memory_order_relaxed) &&
+		    (p->isFloat() || p->isInt() || p->isBool())) {
+			bindHandle(i->second, p);
+			if (isMacroIndex(i->second))
+				static_cast<MacroParameter*>(handles[i->second].para)->setTarget(macroTarget(i->second - firstMacro));
+		}
+	} else {
+		auto i = handleOfParam.find(p);
+		if (i != handleOfParam.end()) unbindHandle(i->second);
 	}
 }
 
-void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, bool right)
+void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, int slot)
 {
+	// any control change may start a sound without input (looper, oscillators)
+	if (!p->isOutput()) mWakeRequest.store(true, std::memory_order_release);
+	if (signalsDeferred()) {
+		// written by the audio thread or another thread, flushChanges()
+		// emits the signal again. Changes which didn't come from the
+		// host or a restore are reported to the host then.
+		deferChange(slot, !rtWriting && !mLoading &&
+			!mApplyingHostParameterChange.load(std::memory_order_acquire));
+		return;
+	}
+	if (mLoading || mMirroring) return;
 	bool multi = mMultiMode;
 	if (editor && editor->GetAlternateDouble() && mMultiMode) multi = false;
-	
-	if (mLoading) return;
 	// don't echo host-driven changes back to host
 	const bool notifyHost = !mApplyingHostParameterChange.load(std::memory_order_acquire);
+	markChanged(slot, !multi, notifyHost);
+}
 
-	juce::MessageManager::callAsync(
-		[this, p, right, multi, notifyHost]
-	{
-		if (multi) return;
-		gx_preset::GxSettings *settings = &((right?machine:machine_r)->get_settings());
-		gx_engine::ParamMap& param = settings->get_param();
-		gx_engine::Parameter& p1 = param[p->id()];
-        juce::RangedAudioParameter* para = findParamForID(p->id().c_str());
-        float newValue = 0.0f;
-		p1.set_blocked(true);
-		if (p1.isFloat()) {
-            newValue = p->getFloat().get_value();
-			p1.getFloat().set(newValue);
-		} else if (p1.isInt()) {
-            newValue = float(p->getInt().get_value());
-			p1.getInt().set(p->getInt().get_value());
-		} else if (p1.isBool()) {
-            newValue = float(p->getBool().get_value());
-			p1.getBool().set(p->getBool().get_value());
-			if (p->id().substr(0, 3) == "ui.")
-			{
-				std::stringstream ss;
-				saveState(ss, right);
-				loadState(ss, !right);
-
-				//if (editor) editor->createPluginEditors(right, !right, false);
-			}
-		}
-		else if (p1.isString())
-			p1.getString().set(p->getString().get_value());
-		else if (dynamic_cast<gx_engine::JConvParameter*>(&p1) != 0)
-		{
-			gx_engine::JConvParameter *pp = dynamic_cast<gx_engine::JConvParameter*>(p);
-			gx_engine::JConvParameter *pp1 = dynamic_cast<gx_engine::JConvParameter*>(&p1);
-			pp1->set(pp->get_value());
-		}
-		else if (dynamic_cast<gx_engine::SeqParameter*>(&p1) != 0)
-		{
-			gx_engine::SeqParameter *pp = dynamic_cast<gx_engine::SeqParameter*>(p);
-			gx_engine::SeqParameter *pp1 = dynamic_cast<gx_engine::SeqParameter*>(&p1);
-			pp1->set(pp->get_value());
-		}
-		p1.set_blocked(false);
-        // forward internal value changes to the host parameters
-        if (para && notifyHost) {
-            para->beginChangeGesture();
-            if (p1.isBool()) para->setValueNotifyingHost(newValue);
-            else if ((p1.isInt()) || (p1.isFloat()))
-                para->setValueNotifyingHost((newValue -
-                    p1.getLowerAsFloat()) / (p1.getUpperAsFloat() - p1.getLowerAsFloat()));
-            para->endChangeGesture();
-        }
+// a slot is queued once per epoch, further changes until the next drain
+// only update its flags
+void GuitarixProcessor::markChanged(int slot, bool mirror, bool notifyHost)
+{
+	ChangeSlot& s = changeSlots[slot];
+	if (s.epoch != mChangeEpoch) {
+		s.epoch = mChangeEpoch;
+		s.notifyHost = false;
+		dirtySlots.push_back(slot);
+	}
+	// the latest change decides if the other machine follows,
+	// any change which didn't come from the host is reported to it
+	s.mirror = mirror;
+	s.notifyHost = s.notifyHost || notifyHost;
+	if (notifyHost) mEdits++;
+}
+
+void GuitarixProcessor::forwardChange(ChangeSlot s)
+{
+	gx_engine::Parameter *p = s.p;
+	// host parameters are bound to the left machine, the right one
+	// only reports changes which the left one follows
+	juce::RangedAudioParameter* para = !s.right ? findParamFor(p)
+		: s.mirror ? findParamForID(p->id().c_str()) : nullptr;
+	// in dual mode the racks are independent, otherwise each machine
+	// (when the right one exists already) mirrors the changes of the other
+	if (s.mirror && s.twin && mRightReady.load(std::memory_order_acquire)) {
+		mMirroring = true;
+		s.twin->set_blocked(true);
+		copyValue(*p, *s.twin);
+		s.twin->set_blocked(false);
+		mMirroring = false;
+		// a rack unit was shown or hidden
+		if (p->isBool() && p->id().compare(0, 3, "ui.") == 0) syncRackOrder();
+	}
+	// forward internal value changes to the host parameters
+	if (para && s.notifyHost && (p->isBool() || p->isInt() || p->isFloat())) {
+		float newValue = p->isBool() ? float(p->getBool().get_value())
+		               : p->isInt() ? float(p->getInt().get_value()) : p->getFloat().get_value();
+		mEchoing = true;
+		para->beginChangeGesture();
+		if (p->isBool()) para->setValueNotifyingHost(newValue);
+		else para->setValueNotifyingHost((newValue -
+			p->getLowerAsFloat()) / (p->getUpperAsFloat() - p->getLowerAsFloat()));
+		para->endChangeGesture();
+		mEchoing = false;
 	}
-	);
 }
 
 /*
@@ -569,7 +1329,7 @@ void GuitarixProcessor::load_preset(std::string _bank, std::string _preset) {
     timer.oldProgram.store(int(getProgramsIndexValue() * presets.size()), std::memory_order_release);
 	if(editor)
 		editor->createPluginEditors();
-    juce::RangedAudioParameter* param = findParamForID("selPreset");
+    juce::RangedAudioParameter* param = sel_preset;
     if (param) {
         float val = param->getValue();
         float newValue = getProgramsIndexValue();
@@ -619,47 +1379,56 @@ void GuitarixProcessor::do_bank_change(int pgm) {
 
 void GuitarixProcessor::connect_value_changed_signal(gx_engine::Parameter *p, bool right)
 {
+	const ChangeSlot c { p, right ? paramIndex[0]->find(p->id()) : findTwin(p), right, false, false, 0 };
+	int slot;
+	if (freeSlots.empty()) {
+		slot = changeSlots.size();
+		changeSlots.push_back(c);
+	} else {
+		// a pending bit of the removed parameter only emits the new one
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+		changeSlots[slot] = c;
+	}
+	slotOf[p] = slot;
+	// the bit block exists before the audio thread can change the parameter
+	if (slot < slot_block * slot_blocks && !slotBits[slot / slot_block].load(std::memory_order_relaxed))
+		slotBits[slot / slot_block].store(new SlotBits(), std::memory_order_release);
 	if (p->isInt()) {
 		p->getInt().signal_changed().connect(
 			sigc::hide(
 				sigc::bind(
-					sigc::bind(
-						sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), right), p)));
+					sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), p, slot)));
 	}
 	else if (p->isBool()) {
 		p->getBool().signal_changed().connect(
 			sigc::hide(
 				sigc::bind(
-					sigc::bind(
-						sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), right), p)));
+					sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), p, slot)));
 	}
 	else if (p->isFloat()) {
 		p->getFloat().signal_changed().connect(
 			sigc::hide(
 				sigc::bind(
-					sigc::bind(
-						sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), right), p)));
+					sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), p, slot)));
 	}
 	else if (p->isString()) {
 		p->getString().signal_changed().connect(
 			sigc::hide(
 				sigc::bind(
-					sigc::bind(
-						sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), right), p)));
+					sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), p, slot)));
 	}
 	else if (dynamic_cast<gx_engine::JConvParameter*>(p) != 0) {
 		dynamic_cast<gx_engine::JConvParameter*>(p)->signal_changed().connect(
 			sigc::hide(
 				sigc::bind(
-					sigc::bind(
-						sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), right), p)));
+					sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), p, slot)));
 	}
 	else if (dynamic_cast<gx_engine::SeqParameter*>(p) != 0) {
 		dynamic_cast<gx_engine::SeqParameter*>(p)->signal_changed().connect(
 			sigc::hide(
 				sigc::bind(
-					sigc::bind(
-						sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), right), p)));
+					sigc::mem_fun(*this, &GuitarixProcessor::on_param_value_changed), p, slot)));
 	}
 }
 
@@ -703,23 +1472,185 @@ bool GuitarixProcessor::isMidiEffect() const
 
 double GuitarixProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    double t = mTailSeconds.load(std::memory_order_acquire);
+    if (SampleRate) t += double(getLatencySamples()) / SampleRate;
+    return t;
 }
 
-float GuitarixProcessor::getProgramsIndexValue() {
-	gx_preset::GxSettings* settings = &(machine->get_settings());
+//==============================================================================
+// the convolvers run in sync with the engine quantum and add no latency,
+// but units running a model through the FixedRateResampler do, when the
+// session rate differs from the model rate. Up- and down-sampling each
+// add the half filter length of the zita resampler (hlen 16).
+static const char *resampled_units[] = {
+    "nam.on_off", "snam.on_off", "mnam.on_off",
+    "rtneural.on_off", "srtneural.on_off", "mrtneural.on_off",
+};
+static const int resampled_rate = 48000;
+static const int resampler_latency = 2 * 16;
+
+// units producing a tail after the input stopped. The tail of delays and
+// reverbs depends on their time, feedback and decay settings, the seconds
+// are an estimate for the host and the engine doesn't sleep while one of
+// them runs. The convolver tails are calculated from the loaded IR.
+static const struct { const char *on_off; double seconds; } tail_units[] = {
+    { "amp.feed_on_off",          3.0 },
+    { "stereoverb.on_off",        4.0 },
+    { "zita_rev1.on_off",         8.0 },
+    { "delay.on_off",            10.0 },
+    { "echo.on_off",             10.0 },
+    { "stereodelay.on_off",      10.0 },
+    { "stereoecho.on_off",       10.0 },
+    { "digital_delay.on_off",    10.0 },
+    { "digital_delay_st.on_off", 10.0 },
+};
+static const char *tail_convolvers[] = { "jconv", "jconv_mono" };
+// LV2 and LADSPA units may be delays or reverbs as well
+static const double plugin_tail = 10.0;
 
-	std::string bp;
-	std::string bank;
-	std::string preset;
-	if (settings->setting_is_preset()) {
-		bank = settings->get_current_bank();
-		preset = settings->get_current_name();
-	} else {
-		bank = "";
-		preset = "";
-        return 0.0;
-	}
+static bool is_plugin_unit(const std::string& id)
+{
+    return id.compare(0, 4, "lv2_") == 0 || id.compare(0, 7, "ladspa_") == 0;
+}
+
+bool GuitarixProcessor::unit_active(const std::string& on_off, bool right)
+{
+    return paramIndex[right]->isOn(on_off);
+}
+
+// units which alias or oversample on their own and should run at the
+// session rate, while one of them is active the internal rate is not used
+static const char *full_rate_units[] = {
+    "ts9sim.on_off", "gxdistortion.on_off", "overdrive.on_off",
+    "gx_fuzzface.on_off", "fuzzface.on_off", "fumaster.on_off",
+};
+static const int internal_rates[] = { 44100, 48000 };
+
+// the racks run at session rate / div, div being the largest integer
+// divisor which lands on 44.1 or 48 kHz and divides the quantum
+int GuitarixProcessor::getRateDiv(int sampleRate)
+{
+    if (!mInternalRate) return 1;
+    for (auto u : full_rate_units)
+        if (unit_active(u) || (dualActive() && unit_active(u, true))) return 1;
+    for (int div = 4; div > 1; div--)
+        for (auto r : internal_rates)
+            if (sampleRate == r * div && quantum % div == 0) return div;
+    return 1;
+}
+
+// the model units are part of the engine, their parameters live as long as the machine
+void GuitarixProcessor::findResampledUnits(bool right)
+{
+    resampledUnits[right].clear();
+    for (auto u : resampled_units)
+        if (gx_engine::Parameter *p = paramIndex[right]->find(u))
+            if (p->isBool()) resampledUnits[right].push_back(p);
+}
+
+// latency of the model resamplers in a rack running at rate
+static int units_latency(const ParamIndex& index, int rate)
+{
+    if (rate == resampled_rate) return 0;
+    int latency = 0;
+    for (auto u : resampled_units)
+        if (index.isOn(u)) latency += resampler_latency;
+    return latency;
+}
+
+static int units_latency(const std::vector<gx_engine::Parameter*>& units, int rate)
+{
+    if (rate == resampled_rate) return 0;
+    int latency = 0;
+    for (auto p : units)
+        if (p->getBool().get_value()) latency += resampler_latency;
+    return latency;
+}
+
+// reads only the cached unit switches, so the audio thread can call it
+int GuitarixProcessor::getEngineLatency() const
+{
+    if (!SampleRate) return 0;
+    // the internal rate resamplers work at the engine rate,
+    // so does the model resampler of the units
+    int latency = mRateDiv > 1 ? resampler_latency : 0;
+    // in dual mode the slower rack sets the latency
+    int units = units_latency(resampledUnits[0], SampleRate / mRateDiv);
+    if (dualActive()) units = std::max(units, units_latency(resampledUnits[1], SampleRate / mRateDiv));
+    return (latency + units) * mRateDiv;
+}
+
+// the latency the output runs at right now, the host learns it a timer tick later
+int GuitarixProcessor::currentLatency() const
+{
+    return mRingLatency.load(std::memory_order_acquire)
+         + mEngineLatency.load(std::memory_order_acquire);
+}
+
+double GuitarixProcessor::getEngineTailSeconds(bool& timed)
+{
+    timed = false;
+    if (!SampleRate) return 0.0;
+    double tail = 0.0;
+    for (auto& u : tail_units)
+        if (unit_active(u.on_off) || (dualActive() && unit_active(u.on_off, true))) {
+            tail = std::max(tail, u.seconds);
+            timed = true;
+        }
+    for (int right = 0; right < (dualActive() ? 2 : 1); right++)
+        for (int stereo = 0; stereo < 2; stereo++)
+            for (const auto& unit : get_machine(right)->get_settings().get_rack_unit_order(stereo))
+                if (is_plugin_unit(unit) && unit_active(unit + ".on_off", right)) {
+                    tail = std::max(tail, plugin_tail);
+                    timed = true;
+                }
+    for (auto c : tail_convolvers) {
+        std::string id(c);
+        if (!unit_active(id + ".on_off")) continue;
+        gx_engine::JConvParameter *jc = dynamic_cast<gx_engine::JConvParameter*>(
+            paramIndex[0]->find(id + ".convolver"));
+        if (jc) {
+            const gx_engine::GxJConvSettings& j = jc->get_value();
+            tail = std::max(tail, double(j.getLength() + j.getDelay()) / SampleRate);
+        }
+    }
+    return tail;
+}
+
+// called from prepareToPlay() and the message thread timer, the audio thread
+// only publishes the ring latency, the host is told here
+void GuitarixProcessor::updateLatency()
+{
+    if (!SampleRate) return;
+    // a unit which needs the session rate was switched on or off
+    if (getRateDiv(SampleRate) != mRateDiv) {
+        reprepare();
+        return;
+    }
+    // without process calls the audio thread doesn't publish it
+    mEngineLatency.store(getEngineLatency(), std::memory_order_release);
+    const int latency = currentLatency();
+    bool timed;
+    mTailSeconds.store(getEngineTailSeconds(timed), std::memory_order_release);
+    mTimedTail.store(timed, std::memory_order_release);
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+}
+
+float GuitarixProcessor::getProgramsIndexValue() {
+	gx_preset::GxSettings* settings = &(machine->get_settings());
+
+	std::string bp;
+	std::string bank;
+	std::string preset;
+	if (settings->setting_is_preset()) {
+		bank = settings->get_current_bank();
+		preset = settings->get_current_name();
+	} else {
+		bank = "";
+		preset = "";
+        return 0.0;
+	}
 
     int i = 0;
 	gx_system::PresetBanks* bb = &settings->banks;
@@ -823,71 +1754,259 @@ void GuitarixProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     // initialisation that you need..
 //	gx_system::CmdlineOptions *options=0;
 //	jack->gx_jack_connection(true, true, 0, *options);
+    // hosts prepare again on transport start, bounce and routing changes,
+    // the engines are only set up again when their format changed, the
+    // state of the stream (delay lines, converters) always starts over
+    const bool rateChanged = SampleRate != static_cast<int>(sampleRate);
     SampleRate = static_cast<int>(sampleRate);
-    jack->get_engine().set_rack_changed();
     proc.setTimeOut(std::max(100,static_cast<int>((samplesPerBlock/(sampleRate*0.000001))*0.1)));
     proc.set<GuitarixProcessor, &GuitarixProcessor::processParallel>(this);
 
-    for(auto &r: rms)
+    if (rateChanged) meter.setup(SampleRate);
+    setupCapture();
+    mSleeping = false;
+    mOutputSilent = false;
+    mSilentFor = 0;
+    mQuietFor = 0;
+    setupDryLine();
+
+    const bool quantumChanged = buffersize!=samplesPerBlock || qLowLatency!=mLowLatency || qNonRealtime!=isNonRealtime();
+    if (quantumChanged)
     {
-        r.reset(sampleRate, 0.5);
-        r.setCurrentAndTargetValue(-100.f);
+        setup_quantum(samplesPerBlock);
     }
-
-    if (buffersize!=samplesPerBlock)
+    else if (mDirect != qDirect)
     {
-        delete out[0]; out[0]=0;
-        delete out[1]; out[1]=0;
-        quantum=buffersize=samplesPerBlock;
-        
-        if(samplesPerBlock & (samplesPerBlock-1))
-        {
-            int k;
-            for (k=6; (1<<k) < buffersize; k++)
-                if(buffersize-(1<<k)<=(1<<k)) break;
-            quantum=(1<<k);
-            int q=buffersize-quantum;
-            int l=quantum/q; if(l*q<quantum) l++;
-            
-            //delay=(l-1)*q;
-			delay=quantum-1;
-        }
-        else
-        {
-            if(buffersize>=1024) quantum=buffersize/4;
-            else if(buffersize>=512) quantum=buffersize/2;
-            delay=0;
-        }
-        wpos=0;
-        rpos=0;
-        ppos=0;
-        olen=((buffersize+quantum-1)/quantum+1)*quantum;
-		tdelay=0;
+        // a short block left direct mode, start over in place
+        mDirect = qDirect;
+        reset_ring();
+    }
+
+	mRateDiv = getRateDiv(SampleRate);
+	// the converters keep filter state of the last run, a new stream
+	// starts them over even when the format is the same
+	if (mRateDiv > 1)
+	{
+		for (int c = 0; c < 2; c++)
+		{
+			if (!rateConv[c]) rateConv[c].reset(new gx_resample::FixedRateResampler());
+			rateConv[c]->setup(SampleRate, SampleRate / mRateDiv);
+			rateBuf[c].assign(quantum, 0.f);
+		}
+	}
+	setupAuxBuses();
+	const int engineRate = SampleRate / mRateDiv;
+	const int engineQuantum = quantum / mRateDiv;
+
+	// the engines are only initialized again for a new rate or buffer size
+	if (engineRate != mEngineRate || engineQuantum != mEngineQuantum)
+	{
+		snapshot[0]->capture(machine, *paramIndex[0]);
+		// in dual mode the right machine has settings of its own
+		const bool dual = mMultiMode && mRightReady.load(std::memory_order_acquire);
+		if (dual) snapshot[1]->capture(machine_r, *paramIndex[1]);
+
+		jack->buffersize_callback(engineQuantum);
+		jack->srate_callback(engineRate);
+		if (jack_r)
+		{
+			jack_r->buffersize_callback(engineQuantum);
+			jack_r->srate_callback(engineRate);
+		}
+
+		//Restore state - workaround to override parameters reset during Dsp::init() on sample rate change
+		mLoading = true;
+		snapshot[0]->restore(machine, *paramIndex[0]);
+		if (dual) snapshot[1]->restore(machine_r, *paramIndex[1]);
+		mLoading = false;
+		if (!dual) cloneSettingsToMachineR();
+		jack->get_engine().set_rack_changed();
+		if (jack_r) jack_r->get_engine().set_rack_changed();
+		mEngineRate = engineRate;
+		mEngineQuantum = engineQuantum;
+	}
+
+	gx_inited();
+	updateLatency();
+}
 
-        DBG("***PREPARE buffersize:"<<buffersize<<" delay:"<<delay<<" quantum:"<<quantum<<" olen:"<<olen);
+// the engine always runs in quantum sized chunks. When the host block is a
+// multiple of the quantum it is processed in place (direct mode), otherwise
+// the out[] ring re-quantizes it at the cost of delay samples latency.
+// mLowLatency prefers a small quantum dividing the block (no ring latency),
+// low cpu load prefers the largest quantum the block allows. Offline
+// rendering always uses the low cpu policy.
+static const int min_quantum = 32;
+static const int max_quantum = 4096;
 
-        out[0]=new float[olen];
-        out[1]=new float[olen];
+void GuitarixProcessor::setup_quantum(int samplesPerBlock)
+{
+    delete[] out[0]; out[0]=0;
+    delete[] out[1]; out[1]=0;
+    quantum=buffersize=samplesPerBlock;
+    qLowLatency=mLowLatency;
+    qNonRealtime=isNonRealtime();
+    const bool lowLatency=qLowLatency && !qNonRealtime;
+    // largest power of two dividing the host block
+    const int divisor=buffersize & -buffersize;
+
+    if(!(samplesPerBlock & (samplesPerBlock-1)))
+    {
+        if(!lowLatency) quantum=std::min(buffersize, max_quantum);
+        else if(buffersize>=1024) quantum=buffersize/4;
+        else if(buffersize>=512) quantum=buffersize/2;
+        mDirect=true;
+    }
+    else if(lowLatency && divisor>=min_quantum)
+    {
+        quantum=std::min(divisor, max_quantum);
+        mDirect=true;
     }
+    else
+    {
+        int k;
+        for (k=6; (1<<k) < buffersize; k++)
+            if(buffersize-(1<<k)<=(1<<k)) break;
+        quantum=(1<<k);
+        mDirect=false;
+    }
+    qDirect=mDirect;
+    // the ring is allocated in direct mode too, it takes over
+    // when the host starts to send irregular block sizes
+    olen=((buffersize+quantum-1)/quantum+1)*quantum;
+    reset_ring();
 
-	std::ostringstream os;
-	saveState(os, false);
+    DBG("***PREPARE buffersize:"<<buffersize<<" delay:"<<delay<<" quantum:"<<quantum<<" olen:"<<olen<<" direct:"<<mDirect);
 
-	jack->buffersize_callback(quantum);
-	jack->srate_callback((int)sampleRate);
-	jack_r->buffersize_callback(quantum);
-	jack_r->srate_callback((int)sampleRate);
+    out[0]=new float[olen];
+    out[1]=new float[olen];
+}
 
-	//Restore state - workaround to override parameters reset during Dsp::init() on sample rate change
-	mLoading = true;
-	std::istringstream is(os.str());
-	loadState(is, false);
-	mLoading = false;
-	cloneSettingsToMachineR();
-    jack->get_engine().set_rack_changed();
-    jack_r->get_engine().set_rack_changed();
+void GuitarixProcessor::reset_ring()
+{
+    applyEvents(std::numeric_limits<int64_t>::max());
+    compactEvents();
+    mInputPos=mEnginePos=0;
+    wpos=0;
+    rpos=0;
+    ppos=0;
+    tdelay=0;
+    delay=mDirect ? 0 : quantum-1;
+    mRegular=0;
+    mRingLatency.store(delay, std::memory_order_release);
+}
 
-	gx_inited();
+// back from the ring once the blocks are regular again. The engine position
+// catches up with the input, the samples still in the ring are dropped and
+// the automation points keep their position in the input stream.
+void GuitarixProcessor::resume_direct()
+{
+    mDirect=true;
+    mRegular=0;
+    mEnginePos=mInputPos;
+    wpos=0;
+    rpos=0;
+    ppos=0;
+    tdelay=0;
+    delay=0;
+    mRingLatency.store(0, std::memory_order_release);
+}
+
+// quantum policy changed, rebuild the ring and the engine buffers
+// while the host callback is held off
+void GuitarixProcessor::reprepare()
+{
+    if (!SampleRate || !buffersize) return;
+    suspendProcessing(true);
+    prepareToPlay(getSampleRate(), buffersize);
+    suspendProcessing(false);
+}
+
+void GuitarixProcessor::SetLowLatency(bool on)
+{
+    machine->set_parameter_value("engine.low_latency", on);
+}
+
+void GuitarixProcessor::SetInternalRate(bool on)
+{
+    machine->set_parameter_value("engine.internal_rate", on);
+}
+
+//==============================================================================
+void GuitarixProcessor::SetCaptureMinutes(int minutes)
+{
+    machine->set_parameter_value("engine.capture_minutes", float(minutes));
+}
+
+// called from prepareToPlay, the ring is only rebuild when its size changes
+void GuitarixProcessor::setupCapture()
+{
+    const size_t frames = size_t(GetCaptureMinutes()) * 60 * SampleRate;
+    if (frames == capture.size()) return;
+    const ScopedLock lock (captureLock);
+    // the ring works unlocked as well, the editor tells the user
+    mCaptureLocked.store(capture.allocate(1, frames), std::memory_order_release);
+}
+
+// copies the capture and renders it through bank/preset on a private
+// engine in the background, the message thread timer reports the result
+bool GuitarixProcessor::startReamp(const std::string& bank, const std::string& preset, const juce::File& target)
+{
+    if (!SampleRate || reamp) return false;
+    std::vector<float> di;
+    {
+        const ScopedLock lock (captureLock);
+        di.resize(capture.available());
+        float *d[1] = { di.data() };
+        // keep a second away from the audio thread
+        di.resize(capture.read(d, di.size(), SampleRate));
+    }
+    if (di.empty()) return false;
+
+    reamp_machine = gx->create_render_machine();
+    gx_jack::GxJack *j = reamp_machine->get_jack();
+    j->gx_jack_connection(true, true, 0, *options);
+    j->buffersize_callback(reamp_quantum);
+    j->srate_callback(SampleRate);
+    gx->gx_load_preset(reamp_machine, bank.c_str(), preset.c_str());
+    j->get_engine().set_rack_changed();
+
+    ParamIndex index;
+    index.attach(reamp_machine->get_settings().get_param());
+    reamp.reset(new ReampRender(j, std::move(di), SampleRate, units_latency(index, SampleRate), target));
+    reamp->startThread(juce::Thread::Priority::low);
+    return true;
+}
+
+float GuitarixProcessor::getReampProgress() const
+{
+    return reamp ? reamp->progress.load(std::memory_order_relaxed) : 0.f;
+}
+
+void GuitarixProcessor::checkReamp()
+{
+    if (!reamp || reamp->isThreadRunning()) return;
+    const bool ok = reamp->ok.load(std::memory_order_acquire);
+    const juce::String file = reamp->getTarget().getFullPathName();
+    reamp.reset();
+    gx->delete_render_machine(reamp_machine);
+    reamp_machine = 0;
+    if (editor)
+        juce::AlertWindow::showAsync (MessageBoxOptions()
+                              .withIconType (ok ? MessageBoxIconType::InfoIcon : MessageBoxIconType::WarningIcon)
+                              .withTitle ("Guitarix Re-amp")
+                              .withMessage (ok ? "Rendered to " + file : "Couldn't render to " + file)
+                              .withButton ("OK"),
+                            nullptr);
+}
+
+// offline bounces wait for the parallel engine without timeouts, so no
+// work of the right channel is ever dropped and renders are repeatable.
+// The VST3 wrapper calls this on the audio thread for every process call.
+void GuitarixProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
+    proc.setBlocking(isNonRealtime);
 }
 
 void GuitarixProcessor::releaseResources()
@@ -914,20 +2033,16 @@ bool GuitarixProcessor::isBusesLayoutSupported (const BusesLayout& layouts) cons
         return false;
    #endif
 
+    // the aux outputs are stereo or switched off
+    for (int i = 1; i < layouts.outputBuses.size(); i++)
+        if (!layouts.outputBuses[i].isDisabled() && layouts.outputBuses[i] != juce::AudioChannelSet::stereo())
+            return false;
+
     return true;
   #endif
 }
 #endif
 
-float GuitarixProcessor::getRMSLevel(float* data, int len) const
-{
-    double sum=0.0;
-    
-    for(int i=0; i<len; i++)
-        sum+=data[i]*data[i];
-    return (float)std::sqrt(sum/len);
-}
-
 #define DBGRT(x)
 
 void GuitarixProcessor::process_midi(juce::MidiBuffer& midiMessages)
@@ -956,6 +2071,11 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     process_midi(midiMessages);
+    mBlockCount.fetch_add(1, std::memory_order_relaxed);
+    applyHostValues();
+    applyFrameBatch();
+    fadeStagedState();
+    mEngineLatency.store(getEngineLatency(), std::memory_order_release);
 
     // In case we have more outputs than inputs, this code clears any output
     // channels that didn't contain input data, (because these aren't
@@ -984,127 +2104,501 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
 		int n = buffer.getNumSamples();
 		buf[0] = buffer.getWritePointer(0);
         buf[1] = buffer.getWritePointer(1);
+        // a mono input bus feeds both chains
+        if (totalNumInputChannels == 1)
+            memcpy(buf[1], buf[0], n*sizeof(float));
 
+        const bool metering = mMeterActive.load(std::memory_order_acquire) && !isNonRealtime();
+        if (metering)
         {
-        for(auto &r: rms) r.skip(n);
+            meter.feed(0, buf[0], n);
+            meter.feed(1, buf[1], n);
+        }
 
-        const auto l=Decibels::gainToDecibels(getRMSLevel(buf[0],n));
-        if(l<rms[0].getCurrentValue()) rms[0].setTargetValue(l); else rms[0].setCurrentAndTargetValue(l);
-        const auto r=Decibels::gainToDecibels(getRMSLevel(buf[1],n));
-        if(r<rms[1].getCurrentValue()) rms[1].setTargetValue(r); else rms[1].setCurrentAndTargetValue(r);
+        // the re-amp engine renders a single mono rack, a capture of
+        // the stereo or dual input couldn't be rendered as it was played
+        if (capture.size()) {
+            if (captureActive()) capture.write(buf, n);
+            else if (capture.available()) capture.clear();
         }
-        
+
+        checkWake(buf, n);
+
+        // keep the dry signal for bypass, the engines stop once faded out
+        const bool bypass = mHostBypass || mBypass.load(std::memory_order_acquire);
+        const int dryStart = dryPos;
+        for (int o = 0; o < n;)
+        {
+            int l = std::min(n-o, dryMask+1-dryPos);
+            memcpy(&dryLine[0][dryPos], buf[0]+o, l*sizeof(float));
+            memcpy(&dryLine[1][dryPos], buf[1]+o, l*sizeof(float));
+            dryPos = (dryPos+l) & dryMask;
+            o += l;
+        }
+        mBypassed = bypass && mBypassGain >= 1.f;
+
+        // a loop end or a transport jump may send one short block,
+        // direct mode comes back after a second of regular ones
+        if(!mDirect && qDirect && out[0])
+        {
+            if(n%quantum) mRegular=0;
+            else if((mRegular+=n) >= SampleRate) resume_direct();
+        }
+
         if(out[0]==0 || out[1]==0)
         {
-            process(buf, n);
+            processChunk(buf, n);
+        }
+        else if(mDirect && !(n%quantum))
+        {
+            processDirect(buf, n);
         }
         else
         {
-            DBGRT("BUF len:"<<n<<" delay:"<<delay);
-            //rpos - reading index in out[], wpos - writing index, ppos - processing index
-            //rpos<=ppos<=wpos (with respect to olen wrapping)
-            
-            {//read input buf[]
-            //read input buf[] up to out[] buffer end
-            int l=n;
-            if(olen-wpos<l) l=olen-wpos;
-            memcpy(out[0]+wpos, buf[0], l*sizeof(float));
-            memcpy(out[1]+wpos, buf[1], l*sizeof(float));
-            wpos+=l;
-            DBGRT("    WPOS:"<<wpos<<" after reading1 "<<l);
-            if(wpos>=olen) wpos-=olen; //wpos=0;
-            
-            //read the rest of input buf[] if nessesary
-            if(n>l)
+            if(mDirect)
             {
-                memcpy(out[0]+wpos, buf[0]+l, (n-l)*sizeof(float));
-                memcpy(out[1]+wpos, buf[1]+l, (n-l)*sizeof(float));
-                wpos+=(n-l);
-                DBGRT("    WPOS:"<<wpos<<" after reading2 "<<(n-l));
-                assert(wpos<=rpos); //buffer should not overflow
+                // the host left the announced block size, re-quantize from now on
+                mDirect=false;
+                reset_ring();
+                DBGRT("***DIRECT MODE LEFT: block:"<<n<<" quantum:"<<quantum);
             }
-            }
-            
-            //process complete quantum-sized chunks
-            while(!(ppos<=wpos && wpos-ppos<quantum))
+            // the ring is sized for buffersize, feed larger blocks in pieces
+            for (int o=0; o<n; o+=buffersize)
             {
-                float *p[2];
-                p[0]=out[0]+ppos;
-                p[1]=out[1]+ppos;
-                process(p, quantum);
-                ppos+=quantum;
-                DBGRT("    PPOS:"<<ppos<<" after processing "<<quantum<<" unprocessed:"<<(wpos>=ppos?wpos-ppos:olen-ppos+wpos));
-                if(ppos>=olen) ppos-=olen; //ppos=0;
+                float *b[2] = { buf[0]+o, buf[1]+o };
+                processRing(b, std::min(buffersize, n-o));
             }
+        }
+        if (bypass || mBypassGain > 0.f) mixBypass(buf, n, dryStart, bypass);
+        if (mDIBus || mTapBus) readAux(buffer, n, dryStart);
+        mInputPos+=n;
+        compactEvents();
+        checkSleep(buf, n);
+
+        if (metering)
+        {
+            meter.feed(2, buf[0], n);
+            meter.feed(3, buf[1], n);
+            meter.commit(n);
+        }
+
+		if (!mSleeping && !mBypassed)
+		{
+			jack->finish_process();
+			if (rightActive()) jack_r->finish_process();
+		}
+	}
+}
 
-            {//write processed
-            //enlarge delay if nessesary
-            int p=olen-rpos;
-            if(ppos>=rpos) p=ppos-rpos;
-            else p+=ppos;
-            if(p+delay<n)
+static const int wake_ramp = 64;
+// shortest engine call between two automation points
+static const int min_span = 16;
+
+// the engine call is split at the automation points of the chunk, a point
+// is applied right before the sample it belongs to. While a convolver runs
+// the chunk is processed as a whole, the points of its first half are
+// applied before it and the others before the next chunk, so no point is
+// more than half a chunk off.
+void GuitarixProcessor::processChunk(float *buf[2], int n)
+{
+    const int64_t end = mEnginePos + n;
+    if (firstEvent == nEvents || events[firstEvent].time >= end || !splitEvents())
+    {
+        if (firstEvent < nEvents) applyEvents(mEnginePos+n/2);
+        processSpan(buf, n);
+        return;
+    }
+    for (int o = 0; o < n;)
+    {
+        applyEvents(mEnginePos+1);
+        int l = n-o;
+        if (firstEvent < nEvents && events[firstEvent].time < end)
+        {
+            // the internal rate converts multiples of mRateDiv only
+            l = std::max(int(events[firstEvent].time - mEnginePos), min_span);
+            l = std::min((l + mRateDiv-1) / mRateDiv * mRateDiv, n-o);
+        }
+        float *p[2] = { buf[0]+o, buf[1]+o };
+        processSpan(p, l);
+        o += l;
+    }
+}
+
+void GuitarixProcessor::processSpan(float *buf[2], int n)
+{
+    if (mBypassed)
+    {
+        // pass the input through, keeps the ring in step with the dry line
+        if (mTapBus) writeTap(nullptr, n);
+    }
+    else if (mSleeping)
+    {
+        memset(buf[0], 0, n*sizeof(float));
+        memset(buf[1], 0, n*sizeof(float));
+        if (mTapBus) writeTap(nullptr, n);
+    }
+    else
+    {
+        processRate(buf, n);
+        if (mWakeRamp)
+        {
+            // fade in the first samples after the engine woke up
+            int l = std::min(n, mWakeRamp);
+            for (int i = 0; i < l; i++)
             {
-                delay=(n-p);
-                DBG("***DELAY INCREASED:"<<delay<<" processed:"<<p<<" required:"<<n);
+                float g = float(wake_ramp - mWakeRamp + i) / wake_ramp;
+                buf[0][i] *= g;
+                buf[1][i] *= g;
             }
-                
-            //clear delay part
-            int o=0;
-            if(delay>0)
-            {
-                int z=delay;
-                if(z>n) z=n;
-                memset(buf[0], 0, z*sizeof(float));
-                memset(buf[1], 0, z*sizeof(float));
-                delay-=z;
+            mWakeRamp -= l;
+        }
+    }
+    mEnginePos+=n;
+}
+
+void GuitarixProcessor::processBlockBypassed(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    // hosts which handle the bypass themselves still get the latency matched dry signal
+    mHostBypass = true;
+    processBlock(buffer, midiMessages);
+    mHostBypass = false;
+}
+
+// room for twice the block plus the largest latency we can report
+void GuitarixProcessor::setupDryLine()
+{
+    int len = 1;
+    while (len < 2*buffersize + 16384) len <<= 1;
+    if (len != dryMask+1)
+    {
+        dryLine[0].assign(len, 0.f);
+        dryLine[1].assign(len, 0.f);
+        dryMask = len-1;
+        dryPos = 0;
+    }
+}
+
+void GuitarixProcessor::mixBypass(float *buf[2], int n, int start, bool bypass)
+{
+    const int latency = std::min(currentLatency(), dryMask+1-n);
+    const float step = 1.f / std::max(1, SampleRate / 100); // 10ms crossfade
+    int r = (start - latency) & dryMask;
+    for (int i = 0; i < n; i++)
+    {
+        if (bypass) mBypassGain = std::min(1.f, mBypassGain + step);
+        else mBypassGain = std::max(0.f, mBypassGain - step);
+        buf[0][i] += (dryLine[0][r] - buf[0][i]) * mBypassGain;
+        buf[1][i] += (dryLine[1][r] - buf[1][i]) * mBypassGain;
+        r = (r+1) & dryMask;
+    }
+}
+
+static const float silence_in = 1e-6f;  // -120dB
+static const float silence_out = 1e-5f; // -100dB
+
+void GuitarixProcessor::checkWake(float *buf[2], int n)
+{
+    float p0, p1, s;
+    peak_sumsq(buf[0], n, p0, s);
+    peak_sumsq(buf[1], n, p1, s);
+    if (std::max(p0, p1) > silence_in || mWakeRequest.exchange(false, std::memory_order_acq_rel))
+    {
+        if (mSleeping)
+        {
+            mSleeping = false;
+            mWakeRamp = wake_ramp;
+        }
+        mSilentFor = 0;
+    }
+    else
+    {
+        mSilentFor += n;
+    }
+    mOutputSilent = false;
+}
+
+// sleep once the input and the engine output were silent for longer than
+// the convolver tail and the latency. Echo repeats may leave gaps of
+// silence, so a single quiet block isn't enough.
+void GuitarixProcessor::checkSleep(float *buf[2], int n)
+{
+    if (mBypassed) return;
+    if (mSleeping)
+    {
+        mOutputSilent = true;
+        return;
+    }
+    // the output isn't measured while the input plays
+    if (!mSilentFor)
+    {
+        mQuietFor = 0;
+        return;
+    }
+    float p0, p1, s;
+    peak_sumsq(buf[0], n, p0, s);
+    peak_sumsq(buf[1], n, p1, s);
+    if (std::max(p0, p1) < silence_out) mQuietFor += n;
+    else mQuietFor = 0;
+    // the delay lines would play their old content on wake up
+    if (mTimedTail.load(std::memory_order_acquire)) return;
+    const int64_t tail = int64_t((mTailSeconds.load(std::memory_order_acquire) + 0.1) * SampleRate)
+                       + currentLatency() + buffersize;
+    if (mSilentFor >= tail && mQuietFor >= tail) mSleeping = true;
+}
+
+void GuitarixProcessor::processDirect(float *buf[2], int n)
+{
+    for (int o=0; o<n; o+=quantum)
+    {
+        float *p[2] = { buf[0]+o, buf[1]+o };
+        processChunk(p, quantum);
+    }
+}
+
+void GuitarixProcessor::processRing(float *buf[2], int n)
+{
+    DBGRT("BUF len:"<<n<<" delay:"<<delay);
+    //rpos - reading index in out[], wpos - writing index, ppos - processing index
+    //rpos<=ppos<=wpos (with respect to olen wrapping)
+    
+    {//read input buf[]
+    //read input buf[] up to out[] buffer end
+    int l=n;
+    if(olen-wpos<l) l=olen-wpos;
+    memcpy(out[0]+wpos, buf[0], l*sizeof(float));
+    memcpy(out[1]+wpos, buf[1], l*sizeof(float));
+    wpos+=l;
+    DBGRT("    WPOS:"<<wpos<<" after reading1 "<<l);
+    if(wpos>=olen) wpos-=olen; //wpos=0;
+    
+    //read the rest of input buf[] if nessesary
+    if(n>l)
+    {
+        memcpy(out[0]+wpos, buf[0]+l, (n-l)*sizeof(float));
+        memcpy(out[1]+wpos, buf[1]+l, (n-l)*sizeof(float));
+        wpos+=(n-l);
+        DBGRT("    WPOS:"<<wpos<<" after reading2 "<<(n-l));
+        assert(wpos<=rpos); //buffer should not overflow
+    }
+    }
+    
+    //process complete quantum-sized chunks
+    while(!(ppos<=wpos && wpos-ppos<quantum))
+    {
+        float *p[2];
+        p[0]=out[0]+ppos;
+        p[1]=out[1]+ppos;
+        processChunk(p, quantum);
+        ppos+=quantum;
+        DBGRT("    PPOS:"<<ppos<<" after processing "<<quantum<<" unprocessed:"<<(wpos>=ppos?wpos-ppos:olen-ppos+wpos));
+        if(ppos>=olen) ppos-=olen; //ppos=0;
+    }
+
+    {//write processed
+    //enlarge delay if nessesary
+    int p=olen-rpos;
+    if(ppos>=rpos) p=ppos-rpos;
+    else p+=ppos;
+    if(p+delay<n)
+    {
+        delay=(n-p);
+        DBG("***DELAY INCREASED:"<<delay<<" processed:"<<p<<" required:"<<n);
+        mRingLatency.store(tdelay+delay, std::memory_order_release);
+    }
+        
+    //clear delay part
+    int o=0;
+    if(delay>0)
+    {
+        int z=delay;
+        if(z>n) z=n;
+        memset(buf[0], 0, z*sizeof(float));
+        memset(buf[1], 0, z*sizeof(float));
+        delay-=z;
 				tdelay += z;
-                DBGRT("    DELAY:"<<delay<<" after cleaning "<<z);
+        DBGRT("    DELAY:"<<delay<<" after cleaning "<<z);
 				DBGRT("    TOTAL DELAY:" << tdelay);
 				o+=z;
-            }
-            
-            //write processed up to out[] buffer end
-            int l=olen-rpos;
-            if(n-o<l) l=n-o;//limit to host buffer length
-            if(ppos>=rpos && ppos-rpos<l)//limit to processed part
-            {
-                l=ppos-rpos;
-                assert(n-o>=l);//there should be processed data to fill host buffer
-            }
-            if(l)
-            {
-                memcpy(buf[0]+o, out[0]+rpos, l*sizeof(float));
-                memcpy(buf[1]+o, out[1]+rpos, l*sizeof(float));
-                rpos+=l;
-                DBGRT("    RPOS:"<<rpos<<" after writing1 "<<l);
-                if(rpos>=olen) rpos-=olen; //rpos=0;
-                o+=l;
-            }
-                
-            //write the rest of the buffer if nessesary
-            if(n-o>0)
-            {
-                assert(rpos==0 && ppos-rpos>=n-o);//second copy can occure only after warap around
-                int l=ppos-rpos;
-                if(n-o<l) l=n-o;//limit to host buffer length
-                memcpy(buf[0]+o, out[0]+rpos, l*sizeof(float));
-                memcpy(buf[1]+o, out[1]+rpos, l*sizeof(float));
-                rpos+=l;
-                DBGRT("    RPOS:"<<rpos<<" after writing2 "<<l);
-                if(rpos>=olen) rpos-=olen; //rpos=0;
-            }
-            }
+    }
+    
+    //write processed up to out[] buffer end
+    int l=olen-rpos;
+    if(n-o<l) l=n-o;//limit to host buffer length
+    if(ppos>=rpos && ppos-rpos<l)//limit to processed part
+    {
+        l=ppos-rpos;
+        assert(n-o>=l);//there should be processed data to fill host buffer
+    }
+    if(l)
+    {
+        memcpy(buf[0]+o, out[0]+rpos, l*sizeof(float));
+        memcpy(buf[1]+o, out[1]+rpos, l*sizeof(float));
+        rpos+=l;
+        DBGRT("    RPOS:"<<rpos<<" after writing1 "<<l);
+        if(rpos>=olen) rpos-=olen; //rpos=0;
+        o+=l;
+    }
+        
+    //write the rest of the buffer if nessesary
+    if(n-o>0)
+    {
+        assert(rpos==0 && ppos-rpos>=n-o);//second copy can occure only after warap around
+        int l=ppos-rpos;
+        if(n-o<l) l=n-o;//limit to host buffer length
+        memcpy(buf[0]+o, out[0]+rpos, l*sizeof(float));
+        memcpy(buf[1]+o, out[1]+rpos, l*sizeof(float));
+        rpos+=l;
+        DBGRT("    RPOS:"<<rpos<<" after writing2 "<<l);
+        if(rpos>=olen) rpos-=olen; //rpos=0;
+    }
+    }
+}
+
+// crossfade the right output to the left chain result (link) or back to the
+// right chain, so switching between one and two chains doesn't click
+void GuitarixProcessor::linkRight(float *out[2], int n, bool link)
+{
+    const float step = 1.f / std::max(1, SampleRate / mRateDiv / 200); // 5ms
+    for (int i = 0; i < n; i++)
+    {
+        if (link) mLinkGain = std::min(1.f, mLinkGain + step);
+        else mLinkGain = std::max(0.f, mLinkGain - step);
+        out[1][i] += (out[0][i] - out[1][i]) * mLinkGain;
+    }
+}
+
+// run the racks at the internal rate, the resamplers convert a quantum
+// into exactly quantum/mRateDiv samples and back
+void GuitarixProcessor::processRate(float *buf[2], int n)
+{
+    float *tap[2] = { tapBuf[0].data(), tapBuf[1].data() };
+    if (mRateDiv == 1)
+    {
+        process(buf, n);
+        if (mTapBus) writeTap(tap, n);
+        return;
+    }
+    float *rbuf[2] = { rateBuf[0].data(), rateBuf[1].data() };
+    const int m = rateConv[0]->up(n, buf[0], rbuf[0]);
+    rateConv[1]->up(n, buf[1], rbuf[1]);
+    jassert(m == n / mRateDiv);
+    // the tap converters need the input count of the chunk too
+    if (mTapBus)
+    {
+        tapConv[0]->up(n, buf[0], tap[0]);
+        tapConv[1]->up(n, buf[1], tap[1]);
+    }
+    process(rbuf, m);
+    rateConv[0]->down(rbuf[0], buf[0]);
+    rateConv[1]->down(rbuf[1], buf[1]);
+    if (mTapBus)
+    {
+        float *host[2] = { tapHost[0].data(), tapHost[1].data() };
+        tapConv[0]->down(tap[0], host[0]);
+        tapConv[1]->down(tap[1], host[1]);
+        writeTap(host, n);
+    }
+}
+
+void GuitarixProcessor::setupAuxBuses()
+{
+    mDIBus = getBusCount(false) > 1 && getBus(false, 1)->isEnabled();
+    mTapBus = getBusCount(false) > 2 && getBus(false, 2)->isEnabled();
+    if (!mTapBus) return;
+    int len = 1;
+    while (len < 2*buffersize + 16384) len <<= 1;
+    for (int c = 0; c < 2; c++)
+    {
+        tapLine[c].assign(len, 0.f);
+        tapBuf[c].assign(std::max(quantum, buffersize), 0.f);
+        tapHost[c].assign(std::max(quantum, buffersize), 0.f);
+        if (mRateDiv > 1)
+        {
+            if (!tapConv[c]) tapConv[c].reset(new gx_resample::FixedRateResampler());
+            tapConv[c]->setup(SampleRate, SampleRate / mRateDiv);
+        }
+    }
+    tapMask = len-1;
+}
+
+// keep the input of the stereo rack for the tap output, that is the
+// output of the mono racks, their cab and convolver included
+void GuitarixProcessor::tapStereoIn(float *out[2], int n)
+{
+    if (!mTapBus) return;
+    memcpy(tapBuf[0].data(), out[0], n*sizeof(float));
+    memcpy(tapBuf[1].data(), out[1], n*sizeof(float));
+}
+
+// store a processed chunk at the engine position, src null stores silence
+void GuitarixProcessor::writeTap(float *src[2], int n)
+{
+    int w = int(mEnginePos & tapMask);
+    for (int o = 0; o < n;)
+    {
+        int l = std::min(n-o, tapMask+1-w);
+        for (int c = 0; c < 2; c++)
+        {
+            if (src) memcpy(&tapLine[c][w], src[c]+o, l*sizeof(float));
+            else memset(&tapLine[c][w], 0, l*sizeof(float));
         }
+        w = (w+l) & tapMask;
+        o += l;
+    }
+}
+
+// fill the aux outputs, they line up with the main output
+void GuitarixProcessor::readAux(juce::AudioBuffer<float>& buffer, int n, int dryStart)
+{
+    if (mDIBus)
+    {
+        auto di = getBusBuffer(buffer, false, 1);
+        const int latency = std::min(currentLatency(), dryMask+1-n);
+        const int r = (dryStart - latency) & dryMask;
+        const int l = std::min(n, dryMask+1-r);
+        for (int c = 0; c < 2 && c < di.getNumChannels(); c++)
         {
-        const auto l=Decibels::gainToDecibels(getRMSLevel(buf[0],n));
-        if(l<rms[2].getCurrentValue()) rms[2].setTargetValue(l); else rms[2].setCurrentAndTargetValue(l);
-        const auto r=Decibels::gainToDecibels(getRMSLevel(buf[1],n));
-        if(r<rms[3].getCurrentValue()) rms[3].setTargetValue(r); else rms[3].setCurrentAndTargetValue(r);
+            float *d = di.getWritePointer(c);
+            memcpy(d, &dryLine[c][r], l*sizeof(float));
+            memcpy(d+l, &dryLine[c][0], (n-l)*sizeof(float));
         }
+    }
+    if (mTapBus)
+    {
+        auto tap = getBusBuffer(buffer, false, 2);
+        const int r = int((mInputPos - mRingLatency.load(std::memory_order_relaxed)) & tapMask);
+        const int l = std::min(n, tapMask+1-r);
+        for (int c = 0; c < 2 && c < tap.getNumChannels(); c++)
+        {
+            float *d = tap.getWritePointer(c);
+            memcpy(d, &tapLine[c][r], l*sizeof(float));
+            memcpy(d+l, &tapLine[c][0], (n-l)*sizeof(float));
+        }
+    }
+}
 
-		jack->finish_process();
-		jack_r->finish_process();
-	}
+// blend the dual mode racks with constant power panning, the gains glide
+// over the chunk so level and pan changes don't click
+void GuitarixProcessor::mixDual(float *out[2], int n)
+{
+    float target[4];
+    for (int c = 0; c < 2; c++)
+    {
+        const float g = juce::Decibels::decibelsToGain(mDualLevel[c]);
+        const float a = (juce::jlimit(-1.f, 1.f, mDualPan[c]) + 1.f) * juce::MathConstants<float>::pi * 0.25f;
+        target[2*c] = g * std::cos(a);
+        target[2*c+1] = g * std::sin(a);
+    }
+    float d[4];
+    for (int k = 0; k < 4; k++) d[k] = (target[k] - mDualGain[k]) / n;
+    for (int i = 0; i < n; i++)
+    {
+        for (int k = 0; k < 4; k++) mDualGain[k] += d[k];
+        const float c1 = out[0][i], c2 = out[1][i];
+        out[0][i] = c1 * mDualGain[0] + c2 * mDualGain[2];
+        out[1][i] = c1 * mDualGain[1] + c2 * mDualGain[3];
+    }
+    for (int k = 0; k < 4; k++) mDualGain[k] = target[k];
 }
 
 void GuitarixProcessor::processParallel()
@@ -1114,37 +2608,62 @@ void GuitarixProcessor::processParallel()
 
 void GuitarixProcessor::process(float *out[2], int n)
 {
-	if (!mStereoMode && !mMultiMode)
+	// the right machine is kept as it is while unused, it doesn't even ramp
+	if ((!mStereoMode && !mMultiMode) || !mRightReady.load(std::memory_order_acquire))
 	{
-		jack->process(n, out[0], out);
-		jack_r->process_ramp(n);
+		if (!mTapBus)
+			jack->process(n, out[0], out);
+		else
+		{
+			jack->process_mono(n, out[0], out[0]);
+			memcpy(out[1], out[0], sizeof(float) * n);
+			tapStereoIn(out, n);
+			jack->process_stereo(n, out, out);
+		}
 	}
     else if(!mStereoMode && mMultiMode)
     {
-		if (mMono2Mute)
-		{
-			memset(out[1], 0, sizeof(float) * n);
-			jack_r->process_ramp_mono(n);
-		}
+        // dual mode: the second rack runs on the parallel thread while
+        // the first one runs here, both are blended into the stereo rack
+        if (!mDualInputs) memcpy(out[1], out[0], sizeof(float) * n);
+        if (mMono2Mute)
+        {
+            memset(out[1], 0, sizeof(float) * n);
+            jack_r->process_ramp_mono(n);
+        }
         else
-            jack_r->process_mono(n, out[0], out[1]);
-		if (mMono1Mute)
-		{
-			memset(out[0], 0, sizeof(float) * n);
-			jack->process_ramp_mono(n);
-		}
+        {
+            sampleToProcess = n;
+            parallelBuffer = out[1];
+            if (proc.getProcess()) {
+                proc.runProcess();
+            } else {
+                processParallel();
+            }
+        }
+        if (mMono1Mute)
+        {
+            memset(out[0], 0, sizeof(float) * n);
+            jack->process_ramp_mono(n);
+        }
         else
             jack->process_mono(n, out[0], out[0]);
+        proc.processWait();
+        mixDual(out, n);
+        tapStereoIn(out, n);
         jack->process_stereo(n, out, out);
-		jack_r->process_ramp_stereo(n);
+        jack_r->process_ramp_stereo(n);
     }
     else //if (mStereoMode)
     {
-		if (mMono2Mute)
-		{
-			memset(out[1], 0, sizeof(float) * n);
-			jack_r->process_ramp_mono(n);
-		}
+        // a mono source on a stereo track, both chains would do the same work
+        const bool same = !memcmp(out[0], out[1], sizeof(float)*n);
+        if (same && mLinkGain >= 1.f)
+        {
+            jack->process_mono(n, out[0], out[0]);
+            memcpy(out[1], out[0], sizeof(float)*n);
+            jack_r->process_ramp_mono(n);
+        }
         else
         {
             sampleToProcess = n;
@@ -1154,15 +2673,11 @@ void GuitarixProcessor::process(float *out[2], int n)
             } else {
                 processParallel();
             }
-        }
-        if (mMono1Mute)
-		{
-            memset(out[0], 0, sizeof(float)*n);
-			jack->process_ramp_mono(n);
-		}
-		else
             jack->process_mono(n, out[0], out[0]);
-        proc.processWait();
+            proc.processWait();
+            if (same || mLinkGain > 0.f) linkRight(out, n, same);
+        }
+        tapStereoIn(out, n);
         jack->process_stereo(n, out, out);
 		jack_r->process_ramp_stereo(n);
 	}
@@ -1192,19 +2707,81 @@ void GuitarixProcessor::saveState(std::ostream& os, bool right)
 	jw.end_array();
 }
 
+bool GuitarixProcessor::hasPendingRight() const
+{
+	return !mPendingRight.empty() || mPendingRightState;
+}
+
+void GuitarixProcessor::loadPendingRight()
+{
+	if (mPendingRightState) {
+		applyMachineState(*mPendingRightState, machine_r);
+	} else if (!mPendingRight.empty()) {
+		ViewStreamBuf buf(mPendingRight.data(), mPendingRight.size());
+		std::istream is(&buf);
+		loadState(is, true);
+	}
+	mPendingRight.clear();
+	mPendingRightState.reset();
+}
+
+// a compact state, the preset is selected by name first when it isn't the
+// current one, so the settings know it, then the stored values are applied
+void GuitarixProcessor::applyMachineState(const MachineState& s, gx_engine::GxMachine *m)
+{
+	gx_preset::GxSettings& settings = m->get_settings();
+	if (!s.bank.empty() && m->get_bank_file(s.bank) &&
+	    (!settings.setting_is_preset() || settings.get_current_bank() != s.bank ||
+	     settings.get_current_name() != s.preset))
+		gx->gx_load_preset(m, s.bank.c_str(), s.preset.c_str());
+	s.apply(m);
+}
+
 void GuitarixProcessor::cloneSettingsToMachineR()
 {
-	std::ostringstream os;
-	saveState(os, false);
+	if (!machine_r) return;
+	// value by value over the paired parameters, no state round trip
+	mMirroring = true;
+	for (const auto& s : changeSlots)
+		if (s.p && s.twin && !s.right && s.p->isSavable() && !s.p->isOutput())
+			copyValue(*s.p, *s.twin);
+	mMirroring = false;
+	syncRackOrder();
+}
 
-	std::istringstream is(os.str());
-	loadState(is, true);
+gx_engine::Parameter* GuitarixProcessor::findTwin(const gx_engine::Parameter *p)
+{
+	if (!machine_r) return nullptr;
+	return paramIndex[1]->find(p->id());
+}
 
-	/*	gx_engine::ParamMap &p = machine->get_settings().get_param();
-		gx_engine::ParamMap &p_r = machine_r->get_settings().get_param();
+// called once the right machine exists
+void GuitarixProcessor::pairSlots()
+{
+	for (auto& s : changeSlots)
+		if (s.p && !s.right) s.twin = findTwin(s.p);
+	for (auto& h : handles)
+		if (gx_engine::Parameter *p = h.p.load(std::memory_order_relaxed))
+			h.twin.store(findTwin(p), std::memory_order_release);
+}
 
-		for (auto i = p.begin(); i != p.end(); i++)
-			p_r[i->first] = *i->second;*/
+// the rack units of the right machine in the order of the left one
+void GuitarixProcessor::syncRackOrder()
+{
+	if (!machine_r) return;
+	gx_preset::GxSettings& settings = machine->get_settings();
+	gx_preset::GxSettings& settings_r = machine_r->get_settings();
+	for (int stereo = 0; stereo < 2; stereo++) {
+		const std::vector<std::string> order = settings.get_rack_unit_order(stereo);
+		const std::vector<std::string> order_r = settings_r.get_rack_unit_order(stereo);
+		if (order == order_r) continue;
+		for (const auto& unit : order_r)
+			settings_r.remove_rack_unit(unit, stereo);
+		for (const auto& unit : order)
+			settings_r.insert_rack_unit(unit, "", stereo);
+		settings_r.signal_rack_unit_order_changed()(stereo);
+	}
+	jack_r->get_engine().set_rack_changed();
 }
 
 const int8 kVersion = 1;
@@ -1213,6 +2790,15 @@ const int8 kZeroVersion = 91;// '['
 void GuitarixProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
 	auto settings = &(machine->get_settings());
+	// a staged state which isn't committed yet is the current one
+	{
+		const ScopedLock lock(restoreLock);
+		if (restoreData.getSize())
+		{
+			destData.append(restoreData.getData(), restoreData.getSize());
+			return;
+		}
+	}
 
 /*	int8 version = kVersion;
 	destData.append(&version, sizeof(version));
@@ -1225,11 +2811,15 @@ void GuitarixProcessor::getStateInformation (juce::MemoryBlock& destData)
 
 	destData.append(currentFile.toStdString().c_str(), slen);
 */
-	std::ostringstream os;
-	saveState(os, false);
-	//::OutputDebugString(os.str().c_str());
-
-	destData.append(os.str().c_str(), os.str().length());
+	// compact chunk, only the values which differ from the defaults,
+	// in dual mode the second rack follows
+	const bool dual = mMultiMode && mRightReady.load(std::memory_order_acquire);
+	juce::MemoryOutputStream payload;
+	payload.writeByte(dual ? 2 : 1);
+	MachineState::write(payload, machine);
+	if (dual) MachineState::write(payload, machine_r);
+	if (mMacroMode) StateChunk::writeMacros(payload, macroIds);
+	StateChunk::wrap(destData, payload, mMacroMode ? StateChunk::f_macros : 0);
 
 	//auto xml = juce::parseXML(os.str().c_str());
 	//copyXmlToBinary()
@@ -1264,31 +2854,401 @@ void GuitarixProcessor::setStateInformation (const void* data, int sizeInBytes)
 	else
 		currentFile = defaultPath.getParentDirectory().getChildFile("---").getFullPathName();
 		*/
-	std::istringstream is;
-	is.str(std::string((const char*)data + offset, sizeInBytes - offset));
+	const bool compact = StateChunk::isChunk(data, sizeInBytes);
+	// the JSON state of older versions was saved with all parameters
+	if (sizeInBytes > 0) checkMacroMode(compact && StateChunk::hasMacros(data, sizeInBytes));
+	// a running instance restores a compact state in stages, see stageState()
+	if (compact && SampleRate && !isNonRealtime())
+	{
+		stageState(data, sizeInBytes);
+		return;
+	}
+	cancelStagedState();
+
+	// the JSON state is read from the host buffer in place
+	ViewStreamBuf legacy;
+	std::istream is(&legacy);
+	MachineState left;
+	std::vector<std::string> macros(macro_slots);
+	// the state of the second rack is loaded once the right machine exists
+	mPendingRight.clear();
+	mPendingRightState.reset();
+	if (compact)
+	{
+		juce::MemoryBlock payload;
+		if (!StateChunk::unwrap(data, sizeInBytes, payload)) return;
+		juce::MemoryInputStream ps(payload, false);
+		const int n = ps.readByte();
+		if (n < 1 || n > 2 || !left.read(ps)) return;
+		if (n == 2)
+		{
+			mPendingRightState.reset(new MachineState());
+			if (!mPendingRightState->read(ps)) mPendingRightState.reset();
+		}
+		StateChunk::readMacros(ps, macros);
+	}
+	else
+	{
+		// JSON state of older versions, the dual mode rack 2 separated by a null byte
+		const char *state = (const char*)data + offset;
+		const char *sep = (const char*)memchr(state, 0, sizeInBytes - offset);
+		legacy.reset(state, sep ? sep - state : sizeInBytes - offset);
+		if (sep) mPendingRight.assign(sep + 1, (const char*)data + sizeInBytes);
+	}
 
-	machine->start_ramp_down();
-	machine_r->start_ramp_down();
-	machine->wait_ramp_down_finished();
-	machine_r->wait_ramp_down_finished();
+	// offline there is nothing to fade and the audio thread may not run
+	// while the host restores the state, so don't wait for a ramp down
+	const bool ramp = !isNonRealtime();
+	// an unused right machine isn't run, so it can't ramp
+	const bool ramp_r = ramp && rightActive();
+	if (ramp)
+	{
+		machine->start_ramp_down();
+		if (ramp_r) machine_r->start_ramp_down();
+		machine->wait_ramp_down_finished();
+		if (ramp_r) machine_r->wait_ramp_down_finished();
+	}
+	loadRestoredState(compact ? &left : nullptr, is);
+	if (compact) applyMacros(macros);
+
+	if (ramp)
+	{
+		machine->start_ramp_up();
+		if (ramp_r) machine_r->start_ramp_up();
+	}
+
+	if (editor)
+	{
+		editor->createPluginEditors();
+		//editor->updateModeButtons();
+	}
+    timer.updateStereoMode = true;
+}
+
+// writes a restored state to the machines while the engines are ramped down,
+// left is null for the JSON state of older versions in is
+void GuitarixProcessor::loadRestoredState(const MachineState *left, std::istream& is)
+{
 	mLoading = true;
-	loadState(is, false);
+	if (left) applyMachineState(*left, machine);
+	else loadState(is, false);
     timer.tStereoMode = mStereoMode;
     SetStereoMode(false);
 	mLoading = false;
-	cloneSettingsToMachineR();
+	if (mMultiMode && hasPendingRight() && mRightReady.load(std::memory_order_acquire))
+	{
+		loadPendingRight();
+	}
+	else
+	{
+		if (!mMultiMode) {
+			mPendingRight.clear();
+			mPendingRightState.reset();
+		}
+		cloneSettingsToMachineR();
+	}
+}
 
-	machine->start_ramp_up();
-	machine_r->start_ramp_up();
+//==============================================================================
+// staged restore: the chunk is parsed on the restore thread, the audio thread
+// starts the ramp down at the next block boundary, and the timer commits the
+// parsed state on the message thread once the engines are silent. The editor
+// follows through the parameter notifications, it's only rebuilt when the
+// rack units changed.
 
-	if (editor)
+void GuitarixProcessor::stageState(const void* data, int sizeInBytes)
+{
 	{
-		editor->createPluginEditors();
-		//editor->updateModeButtons();
+		const ScopedLock lock(restoreLock);
+		restoreData.replaceAll(data, sizeInBytes);
+		restoreGen++;
 	}
+	mRestoreStage.store(rs_parsing, std::memory_order_release);
+	restorePool.addJob([this] { parseStagedState(); });
+}
+
+void GuitarixProcessor::cancelStagedState()
+{
+	const ScopedLock lock(restoreLock);
+	restoreData.reset();
+	restoreGen++;
+	if (mRestoreStage.exchange(rs_idle, std::memory_order_acq_rel) == rs_fading)
+	{
+		machine->start_ramp_up();
+		if (mRestoreRampR) machine_r->start_ramp_up();
+	}
+}
+
+// restore thread
+void GuitarixProcessor::parseStagedState()
+{
+	juce::MemoryBlock data;
+	uint32_t gen;
+	{
+		const ScopedLock lock(restoreLock);
+		data = restoreData;
+		gen = restoreGen;
+	}
+	std::unique_ptr<MachineState> state[2];
+	std::vector<std::string> macros(macro_slots);
+	juce::MemoryBlock payload;
+	bool ok = StateChunk::unwrap(data.getData(), data.getSize(), payload);
+	if (ok)
+	{
+		juce::MemoryInputStream ps(payload, false);
+		const int n = ps.readByte();
+		ok = n == 1 || n == 2;
+		for (int i = 0; ok && i < n; i++)
+		{
+			state[i].reset(new MachineState());
+			ok = state[i]->read(ps);
+		}
+		if (ok) StateChunk::readMacros(ps, macros);
+	}
+	const ScopedLock lock(restoreLock);
+	// a newer state was staged meanwhile
+	if (gen != restoreGen) return;
+	if (!ok)
+	{
+		restoreData.reset();
+		mRestoreStage.store(rs_idle, std::memory_order_release);
+		return;
+	}
+	staged[0] = std::move(state[0]);
+	staged[1] = std::move(state[1]);
+	stagedMacros = std::move(macros);
+	mRestoreStage.store(rs_ready, std::memory_order_release);
+}
+
+// audio thread, at the start of each block
+void GuitarixProcessor::fadeStagedState()
+{
+	int stage = rs_ready;
+	if (mRestoreStage.load(std::memory_order_acquire) != rs_ready) return;
+	// claim the state before the engines are touched, a cancel or
+	// the timer may take it meanwhile
+	if (!mRestoreStage.compare_exchange_strong(stage, rs_claimed, std::memory_order_acq_rel)) return;
+	mRestoreRampR = rightActive();
+	machine->start_ramp_down();
+	if (mRestoreRampR) machine_r->start_ramp_down();
+	// the timer waits for the ramp once the stage is rs_fading,
+	// after a cancel in between the engines run on
+	stage = rs_claimed;
+	if (!mRestoreStage.compare_exchange_strong(stage, rs_fading, std::memory_order_acq_rel)) {
+		machine->start_ramp_up();
+		if (mRestoreRampR) machine_r->start_ramp_up();
+	}
+}
+
+// message thread, from the timer
+void GuitarixProcessor::checkStagedState()
+{
+	const int stage = mRestoreStage.load(std::memory_order_acquire);
+	// without process calls there is nothing to fade
+	const bool stalled = stage == rs_ready && mStalledTicks > 5;
+	if (stage != rs_fading && !stalled) return;
+	std::unique_ptr<MachineState> left;
+	std::vector<std::string> macros;
+	{
+		const ScopedLock lock(restoreLock);
+		if (mRestoreStage.load(std::memory_order_acquire) != stage) return;
+		left = std::move(staged[0]);
+		mPendingRight.clear();
+		mPendingRightState = std::move(staged[1]);
+		macros = std::move(stagedMacros);
+		restoreData.reset();
+	}
+	// the engines were ramped down by the audio thread
+	const bool ramp = stage == rs_fading;
+	const bool ramp_r = ramp && mRestoreRampR;
+	if (ramp && mStalledTicks <= 5)
+	{
+		machine->wait_ramp_down_finished();
+		if (ramp_r) machine_r->wait_ramp_down_finished();
+	}
+	bool rebuild = mMultiMode && mPendingRightState;
+	std::vector<std::string> order[2];
+	for (int stereo = 0; stereo < 2; stereo++)
+		order[stereo] = machine->get_settings().get_rack_unit_order(stereo);
+	std::istringstream is;
+	loadRestoredState(left.get(), is);
+	if (macros.size() == macro_slots) applyMacros(macros);
+	mRestoreStage.store(rs_idle, std::memory_order_release);
+	if (ramp)
+	{
+		machine->start_ramp_up();
+		if (ramp_r) machine_r->start_ramp_up();
+	}
+	for (int stereo = 0; stereo < 2; stereo++)
+		rebuild = rebuild || order[stereo] != machine->get_settings().get_rack_unit_order(stereo);
+	if (editor && rebuild) editor->createPluginEditors();
     timer.updateStereoMode = true;
 }
 
+//==============================================================================
+// A/B compare and undo: the timer records a frame of the preset parameters
+// after edits, a switch to another frame writes the differing values in a
+// batch at the start of the next block. The signals the audio thread held
+// back are emitted on the message thread, values which can't be written
+// by the audio thread (strings, JConv, sequencer) and the rack order follow
+// there.
+
+struct GuitarixProcessor::FrameBatch
+{
+	enum { fb_pending, fb_applying, fb_applied, fb_taken };
+	ParamFrames::Changes changes;
+	std::atomic<int> state{fb_pending};
+};
+
+// message thread, a parameter is unregistered. A batch which the audio
+// thread didn't take yet is dropped, it may hold the parameter.
+void GuitarixProcessor::dropFrameBatch()
+{
+	FrameBatch *b = mFrameBatch.load(std::memory_order_acquire);
+	if (!b) return;
+	int state = FrameBatch::fb_pending;
+	if (!b->state.compare_exchange_strong(state, FrameBatch::fb_taken, std::memory_order_acq_rel)) {
+		// the values are written right now, the parameter is deleted after
+		while (state == FrameBatch::fb_applying) {
+			juce::Thread::yield();
+			state = b->state.load(std::memory_order_acquire);
+		}
+	}
+	mFrameBatch.store(nullptr, std::memory_order_release);
+	retiredBatch = std::move(frameBatch);
+}
+
+bool GuitarixProcessor::canUndo() const
+{
+	return frames->canUndo() || mEdits != mFrameEdits;
+}
+
+bool GuitarixProcessor::canRedo() const
+{
+	return frames->canRedo() && mEdits == mFrameEdits;
+}
+
+int GuitarixProcessor::compareSlot() const
+{
+	return frames->slot();
+}
+
+bool GuitarixProcessor::framesIdle() const
+{
+	return !mFrameBatch.load(std::memory_order_acquire) &&
+		mRestoreStage.load(std::memory_order_acquire) == rs_idle;
+}
+
+// changes which didn't come from edits (host automation, restored
+// states) become part of the current step
+void GuitarixProcessor::syncFrames()
+{
+	const bool edited = mEdits != mFrameEdits;
+	mFrameEdits = mEdits;
+	if (!frames->capture(machine, *paramIndex[0])) return;
+	if (edited) frames->record();
+	else frames->rebase();
+}
+
+// message thread, from the timer
+void GuitarixProcessor::recordFrame()
+{
+	if (framesIdle()) syncFrames();
+}
+
+void GuitarixProcessor::undo()
+{
+	if (!framesIdle()) return;
+	syncFrames();
+	std::unique_ptr<FrameBatch> b(new FrameBatch());
+	if (frames->undo(b->changes)) startFrameBatch(std::move(b));
+}
+
+void GuitarixProcessor::redo()
+{
+	if (!framesIdle()) return;
+	syncFrames();
+	std::unique_ptr<FrameBatch> b(new FrameBatch());
+	if (frames->redo(b->changes)) startFrameBatch(std::move(b));
+}
+
+void GuitarixProcessor::switchCompare()
+{
+	if (!framesIdle()) return;
+	syncFrames();
+	std::unique_ptr<FrameBatch> b(new FrameBatch());
+	if (frames->switchSlot(b->changes)) startFrameBatch(std::move(b));
+}
+
+void GuitarixProcessor::startFrameBatch(std::unique_ptr<FrameBatch> b)
+{
+	if (b->changes.empty()) return;
+	frameBatch = std::move(b);
+	if (frameBatch->changes.values.empty()) {
+		commitFrameBatch();
+		return;
+	}
+	mFrameBatch.store(frameBatch.get(), std::memory_order_release);
+}
+
+// audio thread, at the start of each block
+void GuitarixProcessor::applyFrameBatch()
+{
+	FrameBatch *b = mFrameBatch.load(std::memory_order_acquire);
+	int state = FrameBatch::fb_pending;
+	if (!b || !b->state.compare_exchange_strong(state, FrameBatch::fb_applying, std::memory_order_acq_rel)) return;
+	{
+	ScopedRTWrite rtWrite;
+	for (const auto& w : b->changes.values) writeValue(w);
+	}
+	b->state.store(FrameBatch::fb_applied, std::memory_order_release);
+	if (!isNonRealtime()) timer.update_mode();
+}
+
+// message thread, from the timer
+void GuitarixProcessor::checkFrameBatch()
+{
+	// the batch before is freed once the audio thread can't hold it anymore
+	retiredBatch.reset();
+	FrameBatch *b = mFrameBatch.load(std::memory_order_acquire);
+	if (!b) return;
+	int state = b->state.load(std::memory_order_acquire);
+	if (state == FrameBatch::fb_applied) {
+		for (const auto& w : b->changes.values) emitValue(w);
+	} else if (state == FrameBatch::fb_pending && mStalledTicks > 5 &&
+			b->state.compare_exchange_strong(state, FrameBatch::fb_taken, std::memory_order_acq_rel)) {
+		// without process calls the values are written here
+		for (const auto& w : b->changes.values) writeValue(w);
+	} else {
+		return;
+	}
+	mFrameBatch.store(nullptr, std::memory_order_release);
+	commitFrameBatch();
+}
+
+void GuitarixProcessor::commitFrameBatch()
+{
+	ParamFrames::Changes& c = frameBatch->changes;
+	for (const auto& j : c.json) ParamFrames::writeJSON(j.first, j.second);
+	bool rebuild = false;
+	gx_preset::GxSettings& settings = machine->get_settings();
+	for (int stereo = 0; stereo < 2; stereo++) {
+		if (!c.order[stereo]) continue;
+		for (const auto& unit : settings.get_rack_unit_order(stereo))
+			settings.remove_rack_unit(unit, stereo);
+		for (const auto& unit : *c.order[stereo])
+			settings.insert_rack_unit(unit, "", stereo);
+		settings.signal_rack_unit_order_changed()(stereo);
+		rebuild = true;
+	}
+	if (rebuild) {
+		if (!(mMultiMode && mRightReady.load(std::memory_order_acquire))) syncRackOrder();
+		jack->get_engine().set_rack_changed();
+		if (editor) editor->createPluginEditors();
+	}
+	retiredBatch = std::move(frameBatch);
+}
+
 //==============================================================================
 bool GuitarixProcessor::hasEditor() const
 {
@@ -20,10 +20,14 @@
 
 #include <JuceHeader.h>
 #include <sigc++/sigc++.h>
+#include <unordered_map>
 #include "ParallelThread.h"
+#include "LevelMeter.h"
+#include "CaptureRing.h"
 namespace gx_jack { class GxJack; }
 namespace gx_engine { class GxMachine; class Parameter; }
 namespace gx_system { class CmdlineOptions; }
+namespace gx_resample { class FixedRateResampler; }
 
 //==============================================================================
 /**
@@ -39,6 +43,10 @@ public:
     gx_jack::GxJack *get_jack_r() { return jack_r;}
     gx_engine::GxMachine *get_machine() { return machine;}
     gx_engine::GxMachine *get_machine_r() { return machine_r;}
+    void create_machine_r();
+    // a private engine for offline rendering, owned by the caller
+    gx_engine::GxMachine *create_render_machine();
+    void delete_render_machine(gx_engine::GxMachine *m);
     gx_system::CmdlineOptions *get_options() { return options;}
 
     void gx_load_preset(gx_engine::GxMachine* machine, const char* bank, const char* name);
@@ -55,16 +63,24 @@ private:
 class PluginUpdateTimer : public juce::MultiTimer
 {
 public:
-	PluginUpdateTimer() :tStereoMode(false), updateStereoMode(false), machine(0), editor(0), mUpdateMode(false), program_chg() {}
+	PluginUpdateTimer() :tStereoMode(false), updateStereoMode(false), machine(0), editor(0), mUpdateMode(false), mUpdatePrepare(false), mUpdateRight(false), program_chg() {}
 	void set_machine(gx_engine::GxMachine *m, gx_engine::GxMachine *m_r) { machine = m; machine_r = m_r; }
 	void set_editor(GuitarixEditor* ed) { editor = ed; }
 	void update_mode() { mUpdateMode = true; }
+	void update_prepare() { mUpdatePrepare = true; }
+	void update_right() { mUpdateRight = true; }
 	void timerCallback(int id) override;
     juce::CriticalSection timer_cs;
     std::atomic<int> newProgram;
     std::atomic<int> oldProgram;
     sigc::signal<void,int> program_chg;
     sigc::signal<void,bool> SetStereoMode;
+    sigc::signal<void> update_latency;
+    sigc::signal<void> reprepare;
+    sigc::signal<void> create_right;
+    sigc::signal<void> reamp_check;
+    sigc::signal<void> flush_changes;
+    sigc::signal<void> record_frame;
     bool tStereoMode;
     bool updateStereoMode;
 
@@ -72,9 +88,68 @@ private:
 	gx_engine::GxMachine *machine, *machine_r;
 	GuitarixEditor* editor;
 	bool mUpdateMode;
+	bool mUpdatePrepare;
+	bool mUpdateRight;
 };
 
-class GuitarixProcessor : public juce::AudioProcessor, private juce::AudioProcessorParameter::Listener
+// a host automation point, time is counted in samples of the engine input stream
+struct ParamEvent
+{
+    int64_t time;
+    int index;
+    float value;
+};
+
+class ReampRender;
+class EngineSnapshot;
+class MachineState;
+class ParamIndex;
+class ParamFrames;
+
+// host parameter index -> engine parameter with the cached range,
+// built once by forwardParameters(). Plugin loads and macro slots rebind
+// handles while the audio thread reads them, p is cleared before the
+// range is written and published after it, see bindHandle()
+struct ParamHandle
+{
+    enum Kind { k_none, k_float, k_int, k_bool };
+    juce::RangedAudioParameter* para;
+    std::atomic<gx_engine::Parameter*> p; // null for the wrapper's own parameters
+    // same id in machine_r, written as well while the racks aren't independent
+    std::atomic<gx_engine::Parameter*> twin;
+    std::atomic<float> lower, range;
+    std::atomic<int> kind;
+    ParamHandle() : para(nullptr), p(nullptr), twin(nullptr), lower(0.f), range(1.f), kind(k_none) {}
+    ParamHandle(const ParamHandle& h)
+        : para(h.para), p(h.p.load()), twin(h.twin.load()), lower(h.lower.load()),
+          range(h.range.load()), kind(h.kind.load()) {}
+};
+
+// host parameter of a macro slot, the name shows the bound engine parameter
+class MacroParameter : public juce::AudioParameterFloat
+{
+public:
+    explicit MacroParameter(int n)
+        : juce::AudioParameterFloat(juce::ParameterID("macro" + juce::String(n), 1), "Macro " + juce::String(n), 0.f, 1.f, 0.f),
+          number(n) {}
+    void setTarget(const juce::String& t) { const juce::ScopedLock lock(cs); target = t; }
+    juce::String getName(int maximumStringLength) const override
+    {
+        juce::String n("Macro " + juce::String(number));
+        {
+            const juce::ScopedLock lock(cs);
+            if (target.isNotEmpty()) n << ": " << target;
+        }
+        return n.substring(0, maximumStringLength);
+    }
+private:
+    const int number;
+    juce::String target;
+    juce::CriticalSection cs;
+};
+
+class GuitarixProcessor : public juce::AudioProcessor, public juce::VST3ClientExtensions,
+                          private juce::AudioProcessorParameter::Listener
 {
 public:
 	//==============================================================================
@@ -84,12 +159,19 @@ public:
 	//==============================================================================
 	void prepareToPlay(double sampleRate, int samplesPerBlock) override;
 	void releaseResources() override;
+	void setNonRealtime(bool isNonRealtime) noexcept override;
 
 #ifndef JucePlugin_PreferredChannelConfigurations
 	bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
 #endif
 
 	void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+	void processBlockBypassed(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+	juce::AudioProcessorParameter* getBypassParameter() const override { return par_bypass; }
+	juce::VST3ClientExtensions* getVST3ClientExtensions() override { return this; }
+	void parameterPointReceived(int parameterIndex, int sampleOffset, float value) override;
+	// only the main output sleeps, the DI output drains the delayed dry line
+	bool isOutputSilent(int bus) const override { return bus == 0 && mOutputSilent; }
 	void process_midi(juce::MidiBuffer& midiMessages);
 	//==============================================================================
 	juce::AudioProcessorEditor* createEditor() override;
@@ -97,7 +179,7 @@ public:
 	juce::AudioProcessorEditor* getEditor() ;
 	bool hasEditor() const override;
 
-	void set_editor(GuitarixEditor* ed) { editor = ed; timer.set_editor(ed); compareParameters(); }
+	void set_editor(GuitarixEditor* ed) { editor = ed; mMeterActive.store(ed != nullptr, std::memory_order_release); timer.set_editor(ed); compareParameters(); }
 	double scale;
 	//==============================================================================
 	const juce::String getName() const override;
@@ -122,11 +204,22 @@ public:
 
 	void SetStereoMode(bool on);
 	bool GetStereoMode() const { return mStereoMode; }
-	void SetMultiMode(bool on) { mMultiMode = on; }
+	// dual mode: two independent mono racks, fed by one guitar or by the
+	// left and right input, blended into the stereo rack
+	void SetMultiMode(bool on);
 	bool GetMultiMode() const { return mMultiMode; }
 	void SetMonoMute(bool m1, bool m2) { mMono1Mute = m1; mMono2Mute = m2; }
 	void GetMonoMute(bool &m1, bool &m2) const { m1 = mMono1Mute; m2 = mMono2Mute; }
+	void SetDualInputs(bool on) { mDualInputs = on; }
+	bool GetDualInputs() const { return mDualInputs; }
+	void SetDualMix(int chain, float level, float pan) { mDualLevel[chain] = level; mDualPan[chain] = pan; }
+	void GetDualMix(int chain, float &level, float &pan) const { level = mDualLevel[chain]; pan = mDualPan[chain]; }
     bool HasSampleRate() { return SampleRate;}
+	void SetLowLatency(bool on);
+	bool GetLowLatency() const { return mLowLatency; }
+	void SetInternalRate(bool on);
+	bool GetInternalRate() const { return mInternalRate; }
+	int GetEngineRate() const { return SampleRate / mRateDiv; }
 
 	void SetPresetsVisible(bool vis) { mPresetsVisible = vis; }
 	bool GetPresetsVisible() const { return mPresetsVisible; }
@@ -134,21 +227,96 @@ public:
 	const juce::String& GetCurrentFile() const { return currentFile; }
 	void SetCurrentFile(const juce::String& f) { currentFile=f; }
 
-    const std::array<juce::LinearSmoothedValue<float>, 4>& getRMSValues() const {return rms;}
+    // input L/R and output L/R levels, safe to call from any thread
+    void getMeterSnapshot(LevelMeter<4>::Snapshot& s) const { meter.read(s); }
+    // DI capture of the last minutes of input, rendered offline through a preset
+    void SetCaptureMinutes(int minutes);
+    int GetCaptureMinutes() const { return int(mCaptureMinutes + 0.5f); }
+    double getCaptureSeconds() const { return SampleRate ? double(capture.available()) / SampleRate : 0.0; }
+    // false when the ring couldn't be locked into RAM and may page on the audio thread
+    bool isCaptureLocked() const { return mCaptureLocked.load(std::memory_order_acquire); }
+    // the capture only runs while the input takes the single mono rack path
+    bool captureActive() const { return !mStereoMode && !mMultiMode; }
+    bool startReamp(const std::string& bank, const std::string& preset, const juce::File& target);
+    bool isReamping() const { return reamp != nullptr; }
+    float getReampProgress() const;
     void load_preset(std::string _bank, std::string _preset);
     void save_preset(std::string _bank, std::string _preset);
     void update_plugin_list(bool add);
     gx_system::CmdlineOptions *get_options() { return options; }
     juce::RangedAudioParameter* findParamForID(const char *id);
+    // true while the audio thread or any other thread than the message
+    // thread writes engine parameters, the signal handlers must not
+    // allocate or touch the GUI then
+    static bool signalsDeferred();
+    // interned parameter ids of the left and right machine, message thread
+    ParamIndex& params(bool right = false) { return *paramIndex[right]; }
+    // A/B compare and undo of the preset parameters of rack 1, the
+    // differing values are written at the next block boundary
+    bool canUndo() const;
+    bool canRedo() const;
+    int compareSlot() const;
+    void undo();
+    void redo();
+    void switchCompare();
+    // optional fixed bank of host parameters, bound to engine parameters at
+    // runtime instead of one host parameter per engine parameter
+    enum { macro_slots = 64 };
+    bool isMacroMode() const { return mMacroMode; }
+    // the layout is fixed for an instance, the preference applies to new ones
+    static bool getMacroPreference();
+    static void setMacroPreference(bool on);
+    bool canBindMacro(const char *id);
+    int macroSlotOf(const char *id) const;
+    juce::String macroTarget(int slot);
+    void bindMacro(int slot, const char *id);
+    // the next macro slot moved by the host is bound to id
+    void learnMacro(const char *id);
+    bool isLearning(const char *id) const { return mLearnArmed.load(std::memory_order_acquire) && mLearnId == id; }
 private:
 	bool mStereoMode, mMultiMode;
+	bool mLowLatency;
+	bool mInternalRate;
 	bool mMono1Mute, mMono2Mute;
+	bool mDualInputs;
+	float mDualLevel[2], mDualPan[2]; // dB, -1 (left) .. 1 (right)
 
 	GuitarixStart *gx;
 	gx_system::CmdlineOptions *options;
 	gx_jack::GxJack *jack, *jack_r;
 	gx_engine::GxMachine *machine, *machine_r;
 	gx_engine::GxMachine *get_machine(bool right = false) { return right ? machine_r: machine; }
+	// machine_r/jack_r are created on first use of stereo input or dual mode,
+	// the audio thread only touches them once mRightReady is set
+	std::atomic<bool> mRightReady{false};
+	void ensureRight();
+	bool rightActive() const { return mRightReady.load(std::memory_order_acquire) && (mStereoMode || mMultiMode); }
+	bool dualActive() const { return mRightReady.load(std::memory_order_acquire) && mMultiMode && !mStereoMode; }
+	// dual mode state of the second rack, restored once it exists,
+	// JSON from older versions or a compact machine state
+	std::string mPendingRight;
+	std::unique_ptr<MachineState> mPendingRightState;
+	bool hasPendingRight() const;
+	void loadPendingRight();
+	void applyMachineState(const MachineState& s, gx_engine::GxMachine *m);
+	void loadRestoredState(const MachineState *left, std::istream& is);
+
+	// staged restore of a compact state, see setStateInformation().
+	// rs_claimed: the audio thread starts the ramp down
+	enum { rs_idle, rs_parsing, rs_ready, rs_claimed, rs_fading };
+	std::atomic<int> mRestoreStage{rs_idle};
+	bool mRestoreRampR = false;
+	juce::CriticalSection restoreLock;
+	juce::MemoryBlock restoreData;
+	uint32_t restoreGen = 0;
+	std::unique_ptr<MachineState> staged[2];
+	std::vector<std::string> stagedMacros;
+	juce::ThreadPool restorePool { 1 };
+	void stageState(const void* data, int sizeInBytes);
+	void cancelStagedState();
+	void parseStagedState();
+	void fadeStagedState();
+	void checkStagedState();
 	GuitarixEditor *editor;
     ParallelThread proc;
 
@@ -157,17 +325,25 @@ private:
     void do_program_change(int pgm);
 	void do_bank_change(int pgm);
 	void cloneSettingsToMachineR();
+	// settings of both machines kept across Dsp::init() in prepareToPlay()
+	std::unique_ptr<EngineSnapshot> snapshot[2];
+	gx_engine::Parameter* findTwin(const gx_engine::Parameter *p);
+	void pairSlots();
+	void syncRackOrder();
 
 	void refreshPrograms();
 	std::vector<std::pair<std::string, std::string>> presets;
 	int currentPreset;
 
+	std::unique_ptr<ParamIndex> paramIndex[2];
 	void connect_value_changed_signal(gx_engine::Parameter *p, bool right);
-	void on_param_value_changed(gx_engine::Parameter *p, bool right);
+	void on_param_value_changed(gx_engine::Parameter *p, int slot);
 	void on_param_insert_remove(gx_engine::Parameter *p, bool inserted, bool right);
 	void on_rack_unit_changed(bool stereo, bool right);
 	// guards on_param_value_changed against host->engine->host feedback when host originated the write
 	std::atomic<bool> mApplyingHostParameterChange{false};
+	// set while the processor reports values to the host, these aren't learned
+	bool mEchoing = false;
 	sigc::signal<void,int> pgm_chg;
 	sigc::signal<void,int> bank_chg;
 	std::string switch_bank;
@@ -177,8 +353,159 @@ private:
     float *out[2];
     int olen, wpos, rpos, ppos;
     int SampleRate;
+    // mDirect: host blocks are processed in place, the ring is only used
+    // when the host sends blocks which aren't a multiple of the quantum.
+    // qDirect is the mode the block size allows, mRegular counts the
+    // samples of regular blocks since the ring took over
+    bool mDirect, qLowLatency, qNonRealtime;
+    bool qDirect = false;
+    int64_t mRegular = 0;
+    void setup_quantum(int samplesPerBlock);
+    void resume_direct();
+
+    // internal rate: at high session rates the racks run at an integer
+    // fraction of it, the signal is resampled once at the chain boundaries
+    int mRateDiv;
+    // rate and buffer size the engines were last initialized with
+    int mEngineRate = 0, mEngineQuantum = 0;
+    std::unique_ptr<gx_resample::FixedRateResampler> rateConv[2];
+    std::vector<float> rateBuf[2];
+    int getRateDiv(int sampleRate);
+    void processRate(float *buf[2], int n);
+    void reset_ring();
+    void reprepare();
+
+    // latency of the out[] ring (tdelay+delay), published by the audio thread
+    std::atomic<int> mRingLatency{0};
+    // latency of the racks, published by the audio thread at block start
+    std::atomic<int> mEngineLatency{0};
+    // on_off of the units with a model resampler of both machines
+    std::vector<gx_engine::Parameter*> resampledUnits[2];
+    void findResampledUnits(bool right);
+    std::atomic<double> mTailSeconds{0.0};
+    // a delay, reverb or plugin unit runs, its tail isn't known exactly
+    std::atomic<bool> mTimedTail{false};
+    bool unit_active(const std::string& on_off, bool right = false);
+    int getEngineLatency() const;
+    int currentLatency() const;
+    double getEngineTailSeconds(bool& timed);
+    void updateLatency();
     
+    // automation points of the running block, sorted by time and applied
+    // right before the engine call which processes their sample position
+    enum { max_events = 512 };
+    std::array<ParamEvent, max_events> events;
+    int nEvents, firstEvent;
+    std::unique_ptr<std::atomic<int>[]> pendingEvents;
+    int64_t mInputPos, mEnginePos;
+    void applyEvents(int64_t until);
+    void compactEvents();
+    // on_off of the convolvers of both machines. They only accept calls of
+    // exactly one quantum, so the engine call is only split at the
+    // automation points while none of them runs
+    std::vector<gx_engine::Parameter*> syncUnits[2];
+    void findSyncUnits(bool right);
+    bool splitEvents() const;
+    void setEngineParameter(int index, float newValue);
+
+    // host parameter changes may arrive on any thread. parameterValueChanged()
+    // only stores the value and flags the index, the audio thread applies the
+    // flagged values at the start of the next block. The engine signals fired
+    // there are flagged by change slot and emitted again by the timer.
+    std::unique_ptr<std::atomic<float>[]> hostValues;
+    std::unique_ptr<std::atomic<uint32_t>[]> hostBits;
+    int nBitWords = 0;
+    // held by the thread applying the host values, the audio thread or
+    // the timer while there are no process calls
+    std::atomic<bool> mApplyingHostValues{false};
+    std::atomic<uint32_t> mBlockCount{0};
+    uint32_t mSeenBlocks;
+    int mStalledTicks;
+    void pushHostValue(int index, float value);
+    void applyHostValues();
+    void flushChanges();
+
+    // engine -> host and rack mirror notification: a changed parameter
+    // marks its slot once per epoch, flushChanges() forwards the final values
+    struct ChangeSlot
+    {
+        gx_engine::Parameter* p;
+        gx_engine::Parameter* twin; // same id in the other machine
+        bool right, mirror, notifyHost;
+        uint32_t epoch;
+    };
+    std::vector<ChangeSlot> changeSlots;
+    std::unordered_map<const gx_engine::Parameter*, int> slotOf;
+    // slots of removed parameters, reused by the next insert
+    std::vector<int> freeSlots;
+    // slots changed off the message thread, in blocks which never move,
+    // so slots can be added meanwhile. loud marks changes which are
+    // reported to the host.
+    enum { slot_block = 4096, slot_blocks = 64 };
+    struct SlotBits
+    {
+        std::atomic<uint32_t> defer[slot_block / 32] {};
+        std::atomic<uint32_t> loud[slot_block / 32] {};
+    };
+    std::atomic<SlotBits*> slotBits[slot_blocks] {};
+    void deferChange(int slot, bool loud);
+    void emitDeferred();
+    std::vector<int> dirtySlots, drainSlots;
+    uint32_t mChangeEpoch = 1;
+    void markChanged(int slot, bool mirror, bool notifyHost);
+    void forwardChange(ChangeSlot s);
+    // set while a value is copied to the other machine, the copy
+    // isn't mirrored back
+    bool mMirroring = false;
+
+    // auto sleep: the engines are not run while the input and the output
+    // were silent for the tail of the convolvers, never while a delay,
+    // reverb or plugin unit runs
+    std::atomic<bool> mWakeRequest{false};
+    bool mSleeping, mOutputSilent;
+    int64_t mSilentFor, mQuietFor;
+    int mWakeRamp;
+    void checkWake(float *buf[2], int n);
+    void checkSleep(float *buf[2], int n);
+
+    // bypass: the engines stop, the dry input is delayed by the reported
+    // latency and crossfaded with the engine output
+    std::atomic<bool> mBypass{false};
+    bool mHostBypass, mBypassed;
+    float mBypassGain;
+    std::vector<float> dryLine[2];
+    int dryMask, dryPos;
+    void setupDryLine();
+    void mixBypass(float *buf[2], int n, int start, bool bypass);
+
+    // aux outputs: the latency matched dry input (DI) and the output of the
+    // mono racks (mono rack out), which feeds the stereo rack. The mono cab
+    // and convolvers run inside the mono rack, so the tap is only pre cab
+    // while they are off. The tap is kept in tapLine at the engine position
+    // and read back with the ring latency, like the output.
+    bool mDIBus, mTapBus;
+    std::vector<float> tapLine[2], tapBuf[2], tapHost[2];
+    int tapMask;
+    std::unique_ptr<gx_resample::FixedRateResampler> tapConv[2];
+    void setupAuxBuses();
+    void tapStereoIn(float *out[2], int n);
+    void writeTap(float *src[2], int n);
+    void readAux(juce::AudioBuffer<float>& buffer, int n, int dryStart);
+
+    // stereo mode with identical L/R input runs the left chain only,
+    // mLinkGain fades the right output between both chains
+    float mLinkGain;
+    void linkRight(float *out[2], int n, bool link);
+
+    // dual mode mix gains, L/R of chain 1 and L/R of chain 2
+    float mDualGain[4];
+    void mixDual(float *out[2], int n);
+
     void process(float *out[2], int n);
+    void processChunk(float *buf[2], int n);
+    void processSpan(float *buf[2], int n);
+    void processDirect(float *buf[2], int n);
+    void processRing(float *buf[2], int n);
     void processParallel();
     int sampleToProcess;
     float *parallelBuffer;
@@ -186,10 +513,51 @@ private:
 	PluginUpdateTimer timer;
 
 	juce::AudioParameterBool* par_stereo;
+	juce::AudioParameterBool* par_bypass;
 	juce::AudioParameterChoice* sel_preset;
     juce::StringArray choices;
-    std::map<int, juce::RangedAudioParameter*> parameterMap;
+    std::vector<ParamHandle> handles;
+    std::unordered_map<const gx_engine::Parameter*, int> handleOfParam;
+    std::unordered_map<std::string, int> handleOfId;
+    void addHandle(juce::RangedAudioParameter* para, gx_engine::Parameter* p);
+    void bindHandle(int index, gx_engine::Parameter* p);
+    void unbindHandle(int index);
+    const ParamHandle* findHandle(int index) const { return index >= 0 && index < int(handles.size()) ? &handles[index] : nullptr; }
+    juce::RangedAudioParameter* findParamFor(const gx_engine::Parameter* p) const;
+    static float normalizedValue(const ParamHandle& h);
     void forwardParameters();
+    static bool isForwarded(gx_engine::Parameter *p);
+    bool mMacroMode = false;
+    // a state saved with the other host parameter layout was restored
+    bool mMacroWarned = false;
+    void checkMacroMode(bool macros);
+    int firstMacro = -1;
+    // engine parameter id of each macro slot, empty for unbound slots
+    std::vector<std::string> macroIds;
+    std::string mLearnId;
+    std::atomic<bool> mLearnArmed{false};
+    std::atomic<int> mLearnedSlot{-1};
+    void addMacroSlots();
+    bool isMacroIndex(int index) const { return mMacroMode && index >= firstMacro && index < firstMacro + macro_slots; }
+    bool setMacro(int slot, const std::string& id);
+    void applyMacros(const std::vector<std::string>& ids);
+    void checkMacroLearn();
+    // A/B and undo frames, the message thread hands the differing values
+    // of a switch to the audio thread in a batch
+    std::unique_ptr<ParamFrames> frames;
+    struct FrameBatch;
+    std::unique_ptr<FrameBatch> frameBatch, retiredBatch;
+    std::atomic<FrameBatch*> mFrameBatch{nullptr};
+    // edits which didn't come from the host, they make undo steps
+    uint32_t mEdits = 0, mFrameEdits = 0;
+    bool framesIdle() const;
+    void syncFrames();
+    void recordFrame();
+    void startFrameBatch(std::unique_ptr<FrameBatch> b);
+    void applyFrameBatch();
+    void checkFrameBatch();
+    void commitFrameBatch();
+    void dropFrameBatch();
     void compareParameters();
 	void parameterValueChanged(int parameterIndex, float newValue) override;
 	void parameterGestureChanged(int, bool) override {}
@@ -200,8 +568,19 @@ private:
 
 	bool mPresetsVisible;
 
-    float getRMSLevel(float* data, int len) const;
-    std::array<juce::LinearSmoothedValue<float>, 4> rms;
+    // dry input of the left channel, written by processBlock
+    CaptureRing capture;
+    std::atomic<bool> mCaptureLocked{true};
+    juce::CriticalSection captureLock;
+    float mCaptureMinutes;
+    void setupCapture();
+    std::unique_ptr<ReampRender> reamp;
+    gx_engine::GxMachine *reamp_machine;
+    void checkReamp();
+
+    // metering is only done while an editor is open
+    LevelMeter<4> meter;
+    std::atomic<bool> mMeterActive{false};
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GuitarixProcessor)
 };
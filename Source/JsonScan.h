@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/****************************************************************
+ ** JsonScan - allocation free JSON reading from a buffer
+ *             requires minimum c++17
+ *
+ *  JsonScanner is a pull scanner over a contiguous buffer in
+ *  the format of gx_system::JsonParser. Tokens are string_views
+ *  into the buffer, string ends are found with memchr(). Only
+ *  string() allocates, and only for the values the caller keeps.
+ *  Commas are treated as separators, a string followed by a
+ *  colon is a key.
+ *
+ *  usage:
+ *      JsonScanner js(data, size);
+ *      if (js.next() == JsonScanner::begin_object)
+ *          while (js.next() == JsonScanner::value_key) {
+ *              if (js.view() == "name" && js.peek() == JsonScanner::value_string) {
+ *                  js.next();
+ *                  name = js.string();
+ *              } else if (!js.skip_value()) break;
+ *          }
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+class JsonScanner
+{
+public:
+    enum token {
+        no_token, end_token, error,
+        begin_object, end_object, begin_array, end_array,
+        value_key, value_string, value_number,
+        value_true, value_false, value_null
+    };
+
+    JsonScanner(const char *data, size_t size)
+        : p(data), e(data + size), tok(no_token), escaped(false) {}
+
+    token current() const { return tok; }
+    bool failed() const { return tok == error; }
+    // text of the current token, strings without the quotes and not unescaped
+    std::string_view view() const { return text; }
+
+    token next() {
+        if (tok == error) return tok;
+        while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t' || *p == ','))
+            p++;
+        if (p == e) return set(end_token, p, 0);
+        const char *s = p;
+        switch (*p) {
+        case '{': p++; return set(begin_object, s, 1);
+        case '}': p++; return set(end_object, s, 1);
+        case '[': p++; return set(begin_array, s, 1);
+        case ']': p++; return set(end_array, s, 1);
+        case '"': return scan_string();
+        case 't': return literal("true", value_true);
+        case 'f': return literal("false", value_false);
+        case 'n': return literal("null", value_null);
+        default:
+            while (p < e && (digit(*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+                p++;
+            if (p == s) return set(error, s, 0);
+            return set(value_number, s, p - s);
+        }
+    }
+
+    token peek() {
+        const char *sp = p;
+        const token st = tok;
+        const std::string_view sv = text;
+        const bool se = escaped;
+        const token t = next();
+        p = sp; tok = st; text = sv; escaped = se;
+        return t;
+    }
+
+    // skips the next value, objects and arrays as a whole
+    bool skip_value() {
+        int depth = 0;
+        do {
+            switch (next()) {
+            case begin_object: case begin_array: depth++; break;
+            case end_object: case end_array: depth--; break;
+            case error: case end_token: return false;
+            default: break;
+            }
+        } while (depth > 0);
+        return depth == 0;
+    }
+
+    // the current string or key, unescaped
+    std::string string() const {
+        if (!escaped) return std::string(text);
+        std::string s;
+        s.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            char c = text[i];
+            if (c != '\\' || i + 1 == text.size()) { s += c; continue; }
+            c = text[++i];
+            switch (c) {
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'n': s += '\n'; break;
+            case 'r': s += '\r'; break;
+            case 't': s += '\t'; break;
+            case 'u': {
+                uint32_t cp = hex4(i + 1);
+                i += 4;
+                // surrogate pair
+                if (cp >= 0xd800 && cp < 0xdc00 && i + 6 < text.size() && text[i+1] == '\\' && text[i+2] == 'u') {
+                    const uint32_t lo = hex4(i + 3);
+                    if (lo >= 0xdc00 && lo < 0xe000) {
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                        i += 6;
+                    }
+                }
+                utf8(s, cp);
+                break;
+            }
+            default: s += c; break; // \" \\ \/
+            }
+        }
+        return s;
+    }
+
+    double number() const {
+        char buf[64];
+        const size_t n = std::min(text.size(), sizeof(buf) - 1);
+        memcpy(buf, text.data(), n);
+        buf[n] = 0;
+        return strtod(buf, nullptr);
+    }
+
+private:
+    const char *p;
+    const char *e;
+    token tok;
+    std::string_view text;
+    bool escaped;
+
+    token set(token t, const char *s, size_t n) {
+        tok = t;
+        text = std::string_view(s, n);
+        return t;
+    }
+
+    token literal(const char *word, token t) {
+        const size_t n = strlen(word);
+        if (size_t(e - p) < n || memcmp(p, word, n) != 0) return set(error, p, 0);
+        const char *s = p;
+        p += n;
+        return set(t, s, n);
+    }
+
+    token scan_string() {
+        const char *s = ++p;
+        const char *q = s;
+        for (;;) {
+            q = static_cast<const char*>(memchr(q, '"', e - q));
+            if (!q) return set(error, s, 0);
+            // a quote behind an odd number of backslashes is escaped
+            const char *b = q;
+            while (b > s && b[-1] == '\\') b--;
+            if ((q - b) % 2 == 0) break;
+            q++;
+        }
+        escaped = memchr(s, '\\', q - s) != nullptr;
+        p = q + 1;
+        const char *c = p;
+        while (c < e && (*c == ' ' || *c == '\n' || *c == '\r' || *c == '\t')) c++;
+        if (c < e && *c == ':') {
+            p = c + 1;
+            return set(value_key, s, q - s);
+        }
+        return set(value_string, s, q - s);
+    }
+
+    uint32_t hex4(size_t i) const {
+        uint32_t v = 0;
+        for (size_t k = i; k < i + 4 && k < text.size(); k++) {
+            const char c = text[k];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        }
+        return v;
+    }
+
+    static void utf8(std::string& s, uint32_t cp) {
+        if (cp < 0x80) s += char(cp);
+        else if (cp < 0x800) { s += char(0xc0 | (cp >> 6)); s += char(0x80 | (cp & 0x3f)); }
+        else if (cp < 0x10000) { s += char(0xe0 | (cp >> 12)); s += char(0x80 | ((cp >> 6) & 0x3f)); s += char(0x80 | (cp & 0x3f)); }
+        else { s += char(0xf0 | (cp >> 18)); s += char(0x80 | ((cp >> 12) & 0x3f)); s += char(0x80 | ((cp >> 6) & 0x3f)); s += char(0x80 | (cp & 0x3f)); }
+    }
+
+    static bool digit(char c) { return c >= '0' && c <= '9'; }
+};
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** LevelMeter - peak and rms metering for the audio thread
+ *
+ *  peak_sumsq() scans a channel once and returns the absolute
+ *  peak and the sum of squares, using AVX, SSE or NEON when
+ *  the compiler targets them.
+ *
+ *  LevelMeter accumulates blocks into windows of a fixed length,
+ *  keeps a peak hold and counts clipped blocks. Every finished
+ *  window is published to the reader through a sequence lock,
+ *  so the GUI thread gets a consistent snapshot without blocking
+ *  the audio thread.
+ *
+ *  usage:
+ *      // audio thread, once per block and channel
+ *      meter.feed(channel, buffer, nframes);
+ *      // audio thread, after all channels of the block are fed
+ *      meter.commit(nframes);
+ *      // any other thread
+ *      LevelMeter<4>::Snapshot s;
+ *      meter.read(s);
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+inline void peak_sumsq(const float *buf, int n, float& peak, float& sumsq)
+{
+    int i = 0;
+    float p = 0.f;
+    float s = 0.f;
+#if defined(__AVX__)
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    __m256 vp = _mm256_setzero_ps();
+    __m256 vs = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(buf + i);
+        vp = _mm256_max_ps(vp, _mm256_andnot_ps(sign, x));
+        vs = _mm256_add_ps(vs, _mm256_mul_ps(x, x));
+    }
+    alignas(32) float tp[8], ts[8];
+    _mm256_store_ps(tp, vp);
+    _mm256_store_ps(ts, vs);
+    for (int k = 0; k < 8; k++) {
+        p = std::max(p, tp[k]);
+        s += ts[k];
+    }
+#elif defined(__SSE__)
+    const __m128 sign = _mm_set1_ps(-0.f);
+    __m128 vp = _mm_setzero_ps();
+    __m128 vs = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(buf + i);
+        vp = _mm_max_ps(vp, _mm_andnot_ps(sign, x));
+        vs = _mm_add_ps(vs, _mm_mul_ps(x, x));
+    }
+    alignas(16) float tp[4], ts[4];
+    _mm_store_ps(tp, vp);
+    _mm_store_ps(ts, vs);
+    for (int k = 0; k < 4; k++) {
+        p = std::max(p, tp[k]);
+        s += ts[k];
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t vp = vdupq_n_f32(0.f);
+    float32x4_t vs = vdupq_n_f32(0.f);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t x = vld1q_f32(buf + i);
+        vp = vmaxq_f32(vp, vabsq_f32(x));
+        vs = vmlaq_f32(vs, x, x);
+    }
+    float tp[4], ts[4];
+    vst1q_f32(tp, vp);
+    vst1q_f32(ts, vs);
+    for (int k = 0; k < 4; k++) {
+        p = std::max(p, tp[k]);
+        s += ts[k];
+    }
+#endif
+    for (; i < n; i++) {
+        p = std::max(p, std::fabs(buf[i]));
+        s += buf[i] * buf[i];
+    }
+    peak = p;
+    sumsq = s;
+}
+
+template <int N>
+class LevelMeter
+{
+public:
+    struct Snapshot {
+        float rms[N];       // linear rms of the last window
+        float peak[N];      // linear peak of the last window
+        float hold[N];      // linear peak hold
+        uint32_t clips[N];  // number of blocks which reached 0dBFS
+    };
+
+    LevelMeter() : window(1024), holdTime(48000), seq(0) { reset(); }
+
+    // window and hold length in samples, call while the audio thread is idle
+    void setup(int sampleRate) {
+        window = std::max(64, sampleRate / 50);
+        holdTime = sampleRate;
+        reset();
+    }
+
+    void reset() {
+        count = 0;
+        for (int i = 0; i < N; i++) {
+            sum[i] = 0.f;
+            pk[i] = 0.f;
+            hd[i] = 0.f;
+            hdAge[i] = 0;
+            cl[i] = 0;
+        }
+        publish();
+    }
+
+    void feed(int ch, const float *buf, int n) {
+        float p, s;
+        peak_sumsq(buf, n, p, s);
+        sum[ch] += s;
+        if (p > pk[ch]) pk[ch] = p;
+        if (p >= 1.f) cl[ch]++;
+    }
+
+    void commit(int n) {
+        count += n;
+        if (count < window) return;
+        for (int i = 0; i < N; i++) {
+            hdAge[i] += count;
+            if (pk[i] >= hd[i] || hdAge[i] > holdTime) {
+                hd[i] = pk[i];
+                hdAge[i] = 0;
+            }
+        }
+        publish();
+        count = 0;
+        for (int i = 0; i < N; i++) {
+            sum[i] = 0.f;
+            pk[i] = 0.f;
+        }
+    }
+
+    void read(Snapshot& s) const {
+        uint32_t b, e;
+        do {
+            b = seq.load(std::memory_order_acquire);
+            for (int i = 0; i < N; i++) {
+                s.rms[i] = rms_[i].load(std::memory_order_relaxed);
+                s.peak[i] = peak_[i].load(std::memory_order_relaxed);
+                s.hold[i] = hold_[i].load(std::memory_order_relaxed);
+                s.clips[i] = clips_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            e = seq.load(std::memory_order_relaxed);
+        } while ((b & 1) || b != e);
+    }
+
+private:
+    int window, holdTime, count;
+    float sum[N], pk[N], hd[N];
+    int hdAge[N];
+    uint32_t cl[N];
+
+    std::atomic<uint32_t> seq;
+    std::atomic<float> rms_[N], peak_[N], hold_[N];
+    std::atomic<uint32_t> clips_[N];
+
+    void publish() {
+        const uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < N; i++) {
+            rms_[i].store(count ? std::sqrt(sum[i] / count) : 0.f, std::memory_order_relaxed);
+            peak_[i].store(pk[i], std::memory_order_relaxed);
+            hold_[i].store(hd[i], std::memory_order_relaxed);
+            clips_[i].store(cl[i], std::memory_order_relaxed);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+};
@@ -56,6 +56,10 @@
  *         processWait() break to avoid Xruns or dead looks. 
  *         That is the worst case and shouldn't happen 
  *         under normal circumstances.
+ *      // optional for offline (non real-time) processing switch off the
+ *         timeouts, getProcess() and processWait() then always wait
+ *         for the thread, so no data is ever lost.
+ *      proc.setBlocking(true);
  *      // Finally stop the thread before exit.
  *      proc.stop(); 
  */
@@ -134,6 +138,7 @@ public:
         : pRun(false)
          ,pWait(false)
          ,isWaiting(false)
+         ,pBlocking(false)
          #if __cplusplus > 201703L
          ,pWorkCond(false)
          #endif
@@ -177,6 +182,11 @@ public:
         timeoutPeriod = timeout;
     }
 
+    // wait without timeout in getProcess() and processWait()
+    void setBlocking(bool blocking) noexcept {
+        pBlocking.store(blocking, std::memory_order_release);
+    }
+
     // try to get the process pointer, return false when thread is busy 
     inline bool getProcess() noexcept {
         if (isRunning() && !getState()) {
@@ -186,7 +196,7 @@ public:
                 if (pthread_cond_timedwait(&pProcCond, &pWaitProc, getTimeOut()) == ETIMEDOUT) {
                     pthread_mutex_unlock(&pWaitProc);
                     maxDuration +=1;
-                    if (maxDuration > 2) {
+                    if (maxDuration > 2 && !pBlocking.load(std::memory_order_acquire)) {
                         break;
                     }
                 } else {
@@ -218,7 +228,7 @@ public:
                 if (pthread_cond_timedwait(&pProcCond, &pWaitProc, getTimeOut()) == ETIMEDOUT) {
                     pthread_mutex_unlock(&pWaitProc);
                     maxDuration +=1;
-                    if (maxDuration > 5) {
+                    if (maxDuration > 5 && !pBlocking.load(std::memory_order_acquire)) {
                         pWait.store(false, std::memory_order_release);
                     }
                 } else {
@@ -248,6 +258,7 @@ private:
     std::atomic<bool> pRun;
     std::atomic<bool> pWait;
     std::atomic<bool> isWaiting;
+    std::atomic<bool> pBlocking;
 
     #if __cplusplus > 201703L
     std::atomic<bool> pWorkCond;
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** ParamFrames - copy on write frames of the preset parameters
+ *                for A/B compare and undo
+ *
+ *  A frame holds the values of all preset parameters of a
+ *  machine and its rack unit order. The values are kept in
+ *  pages of page_size values, frames share the pages which
+ *  didn't change, so an undo step costs the pages touched by
+ *  the edit, not a full copy.
+ *
+ *  capture() reads the machine into the current frame and tells
+ *  if anything changed, record() makes it a new undo step,
+ *  rebase() makes it the current step.
+ *  undo(), redo() and switchSlot() move to another frame and
+ *  list the parameters which differ from the current one, pages
+ *  shared by both frames aren't looked at.
+ *
+ *  The parameter table is rebuilt when the ParamIndex of the
+ *  machine changes its generation (plugins loaded or unloaded),
+ *  the history and the A/B slots are dropped then.
+ *
+ *  usage:
+ *      ParamFrames frames;
+ *      if (frames.capture(machine, index)) frames.record();
+ *      ParamFrames::Changes c;
+ *      if (frames.undo(c))
+ *          for (auto& w : c.values) ... // write w.p
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "guitarix.h"
+#include "ParamIndex.h"
+#include "ViewStreamBuf.h"
+
+class ParamFrames
+{
+public:
+    enum Kind { k_float, k_int, k_bool, k_json };
+    enum { page_size = 64 };
+    enum { max_history = 64 };
+
+    struct Write {
+        gx_engine::Parameter *p;
+        Kind kind;
+        float f;
+        int i;
+    };
+    typedef std::shared_ptr<const std::vector<std::string> > Order;
+    // what differs between two frames
+    struct Changes {
+        std::vector<Write> values;
+        std::vector<std::pair<gx_engine::Parameter*, std::string> > json;
+        Order order[2]; // null when unchanged
+        bool empty() const { return values.empty() && json.empty() && !order[0] && !order[1]; }
+    };
+
+    ParamFrames() : machine(nullptr), gen(0), pos(0), active(0) {}
+
+    bool canUndo() const { return pos > 0; }
+    bool canRedo() const { return pos + 1 < history.size(); }
+    int slot() const { return active; }
+
+    // returns true when the machine differs from the current frame,
+    // index follows the parameter map of m
+    bool capture(gx_engine::GxMachine *m, const ParamIndex& index) {
+        const bool rebuilt = m != machine || index.generation() != gen;
+        if (rebuilt) build(m, index);
+        Frame f;
+        f.pages.resize(current.pages.size());
+        bool changed = rebuilt;
+        for (size_t pg = 0; pg < f.pages.size(); pg++) {
+            const Page *old = current.pages[pg].get();
+            Page page;
+            const size_t end = std::min(entries.size(), (pg + 1) * page_size);
+            bool same = old != nullptr;
+            for (size_t e = pg * page_size; e < end; e++) {
+                Value& v = page.v[e - pg * page_size];
+                read(entries[e], v, old ? &old->v[e - pg * page_size] : nullptr);
+                same = same && equal(v, old->v[e - pg * page_size]);
+            }
+            if (same) f.pages[pg] = current.pages[pg];
+            else {
+                f.pages[pg] = std::make_shared<const Page>(std::move(page));
+                changed = true;
+            }
+        }
+        for (int stereo = 0; stereo < 2; stereo++) {
+            std::vector<std::string> order = m->get_settings().get_rack_unit_order(stereo);
+            if (current.order[stereo] && *current.order[stereo] == order) f.order[stereo] = current.order[stereo];
+            else {
+                f.order[stereo] = std::make_shared<const std::vector<std::string> >(std::move(order));
+                changed = true;
+            }
+        }
+        if (!changed) return false;
+        current = std::move(f);
+        if (rebuilt) {
+            history.assign(1, current);
+            pos = 0;
+            slots[0] = slots[1] = Frame();
+        }
+        return true;
+    }
+
+    // the current frame is a new undo step, the redo steps are dropped
+    void record() {
+        if (same(history[pos], current)) return;
+        history.resize(pos + 1);
+        history.push_back(current);
+        if (history.size() > max_history) history.erase(history.begin());
+        pos = history.size() - 1;
+    }
+
+    // the current frame replaces the current undo step
+    void rebase() {
+        history[pos] = current;
+    }
+
+    bool undo(Changes& c) {
+        if (!canUndo()) return false;
+        moveTo(history[--pos], c);
+        return true;
+    }
+
+    bool redo(Changes& c) {
+        if (!canRedo()) return false;
+        moveTo(history[++pos], c);
+        return true;
+    }
+
+    // keeps the current frame in the active slot and goes to the other one,
+    // an empty slot starts as a copy of the current frame
+    bool switchSlot(Changes& c) {
+        slots[active] = current;
+        active ^= 1;
+        if (slots[active].pages.empty()) {
+            slots[active] = current;
+            return false;
+        }
+        moveTo(slots[active], c);
+        record();
+        return true;
+    }
+
+    // writes a JSON value of Changes::json to its parameter
+    static void writeJSON(gx_engine::Parameter *p, const std::string& json) {
+        ViewStreamBuf buf(json.data(), json.size());
+        std::istream is(&buf);
+        gx_system::JsonParser jp(&is);
+        jp.next(gx_system::JsonParser::begin_object);
+        jp.next(gx_system::JsonParser::value_key);
+        p->readJSON_value(jp);
+        p->setJSON_value();
+    }
+
+private:
+    struct Entry {
+        gx_engine::Parameter *p;
+        Kind kind;
+    };
+    struct Value {
+        float f = 0.f;
+        int i = 0;
+        std::shared_ptr<const std::string> json;
+    };
+    struct Page {
+        Value v[page_size];
+    };
+    struct Frame {
+        std::vector<std::shared_ptr<const Page> > pages;
+        Order order[2];
+    };
+
+    gx_engine::GxMachine *machine;
+    uint32_t gen;
+    std::vector<Entry> entries;
+    Frame current;
+    std::vector<Frame> history;
+    size_t pos;
+    Frame slots[2];
+    int active;
+
+    void build(gx_engine::GxMachine *m, const ParamIndex& index) {
+        gx_engine::ParamMap& pmap = m->get_settings().get_param();
+        entries.clear();
+        for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
+            gx_engine::Parameter *p = i->second;
+            if (!p->isInPreset() || !p->isSavable() || p->isOutput()) continue;
+            entries.push_back({ p, p->isFloat() ? k_float : p->isInt() ? k_int : p->isBool() ? k_bool : k_json });
+        }
+        machine = m;
+        gen = index.generation();
+        current = Frame();
+        current.pages.resize((entries.size() + page_size - 1) / page_size);
+    }
+
+    // a JSON value equal to the old one shares its string
+    static void read(const Entry& e, Value& v, const Value *old) {
+        switch (e.kind) {
+        case k_float: v.f = e.p->getFloat().get_value(); break;
+        case k_int: v.i = e.p->getInt().get_value(); break;
+        case k_bool: v.i = e.p->getBool().get_value(); break;
+        case k_json: {
+            std::ostringstream js;
+            gx_system::JsonWriter jw(&js, false);
+            jw.begin_object();
+            e.p->writeJSON(jw);
+            jw.end_object();
+            jw.close();
+            std::string s = js.str();
+            if (old && old->json && *old->json == s) v.json = old->json;
+            else v.json = std::make_shared<const std::string>(std::move(s));
+            break;
+        }
+        }
+    }
+
+    static bool same(const Frame& a, const Frame& b) {
+        return a.pages == b.pages && a.order[0] == b.order[0] && a.order[1] == b.order[1];
+    }
+
+    static bool equal(const Value& a, const Value& b) {
+        return a.f == b.f && a.i == b.i && (a.json == b.json || (a.json && b.json && *a.json == *b.json));
+    }
+
+    void moveTo(const Frame& to, Changes& c) {
+        for (size_t pg = 0; pg < to.pages.size(); pg++) {
+            if (current.pages[pg] == to.pages[pg]) continue;
+            const size_t end = std::min(entries.size(), (pg + 1) * page_size);
+            for (size_t e = pg * page_size; e < end; e++) {
+                const Value& a = current.pages[pg]->v[e - pg * page_size];
+                const Value& b = to.pages[pg]->v[e - pg * page_size];
+                if (equal(a, b)) continue;
+                if (entries[e].kind == k_json) c.json.emplace_back(entries[e].p, *b.json);
+                else c.values.push_back({ entries[e].p, entries[e].kind, b.f, b.i });
+            }
+        }
+        for (int stereo = 0; stereo < 2; stereo++)
+            if (*current.order[stereo] != *to.order[stereo]) c.order[stereo] = to.order[stereo];
+        current = to;
+    }
+};
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** ParamIndex - interned id lookup for a gx_engine::ParamMap
+ *
+ *  The ParamMap is a std::map keyed by id, each hasId()/[]
+ *  pair walks the tree twice and compares strings all the way
+ *  down. ParamIndex keeps a flat open addressing hash table of
+ *  the ids instead, the hash of an id is computed once.
+ *
+ *  intern() hands out a handle for an id, the handle stays
+ *  valid for the lifetime of the index, also for ids which
+ *  aren't registered (yet). get() with a cached handle is a
+ *  plain array access, it returns null while the parameter
+ *  isn't registered. The index follows plugins which are
+ *  loaded and unloaded through signal_insert_remove(), each
+ *  change bumps generation(). Tables of Parameter pointers
+ *  built from the map are stale once it differs.
+ *
+ *  Lookups and updates happen on the message thread.
+ *
+ *  usage:
+ *      ParamIndex index;
+ *      index.attach(machine->get_settings().get_param());
+ *      int h = index.intern("amp2.stage1.Pregain");
+ *      if (gx_engine::Parameter *p = index.get(h)) ...
+ *      if (index.isOn("cab.on_off")) ...
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "guitarix.h"
+
+class ParamIndex : public sigc::trackable
+{
+public:
+    // (re)builds the index from pmap and follows its changes
+    void attach(gx_engine::ParamMap& pmap) {
+        gen++;
+        for (auto& e : entries) e.p = nullptr;
+        for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i)
+            entries[intern(i->first)].p = i->second;
+        pmap.signal_insert_remove().connect(sigc::mem_fun(*this, &ParamIndex::on_insert_remove));
+    }
+
+    int intern(const char *id) {
+        const uint32_t h = hash(id);
+        int e = lookup(id, h);
+        if (e < 0) e = add(id, h);
+        return e;
+    }
+    int intern(const std::string& id) { return intern(id.c_str()); }
+
+    gx_engine::Parameter *get(int handle) const {
+        return handle >= 0 && handle < int(entries.size()) ? entries[handle].p : nullptr;
+    }
+
+    gx_engine::Parameter *find(const char *id) const {
+        const int e = lookup(id, hash(id));
+        return e < 0 ? nullptr : entries[e].p;
+    }
+    gx_engine::Parameter *find(const std::string& id) const { return find(id.c_str()); }
+
+    // value of a bool parameter, false when it doesn't exist
+    bool isOn(const char *id) const {
+        gx_engine::Parameter *p = find(id);
+        return p && p->isBool() && p->getBool().get_value();
+    }
+    bool isOn(const std::string& id) const { return isOn(id.c_str()); }
+
+    // changes whenever a parameter is registered or unregistered
+    uint32_t generation() const { return gen; }
+
+private:
+    struct Entry {
+        std::string id;
+        uint32_t hash;
+        gx_engine::Parameter *p;
+    };
+    std::vector<Entry> entries;
+    // entry index + 1, 0 marks an empty slot, never filled above half
+    std::vector<int> table;
+    uint32_t gen = 0;
+
+    // FNV-1a
+    static uint32_t hash(const char *s) {
+        uint32_t h = 2166136261u;
+        while (*s) {
+            h ^= uint8_t(*s++);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    int lookup(const char *id, uint32_t h) const {
+        if (table.empty()) return -1;
+        const size_t mask = table.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            const int e = table[i];
+            if (!e) return -1;
+            if (entries[e-1].hash == h && entries[e-1].id == id) return e - 1;
+        }
+    }
+
+    int add(const char *id, uint32_t h) {
+        if ((entries.size() + 1) * 2 > table.size()) grow();
+        entries.push_back({ id, h, nullptr });
+        place(int(entries.size()) - 1);
+        return int(entries.size()) - 1;
+    }
+
+    void place(int e) {
+        const size_t mask = table.size() - 1;
+        size_t i = entries[e].hash & mask;
+        while (table[i]) i = (i + 1) & mask;
+        table[i] = e + 1;
+    }
+
+    // handles are entry indices, they don't move on growth
+    void grow() {
+        table.assign(table.empty() ? 1024 : table.size() * 2, 0);
+        for (int e = 0; e < int(entries.size()); e++) place(e);
+    }
+
+    void on_insert_remove(gx_engine::Parameter *p, bool insert) {
+        gen++;
+        Entry& e = entries[intern(p->id())];
+        if (insert) e.p = p;
+        else if (e.p == p) e.p = nullptr;
+    }
+};
@@ -586,7 +586,7 @@ void PluginEditor::clear()
 
 void PluginEditor::subscribe_timer(std::string id)
 {
-    ed->clist.push_back(id);
+    ed->subscribe_timer(id);
 }
 
 void PluginEditor::getinfo(std::string &text)
@@ -598,10 +598,6 @@ void PluginEditor::getinfo(std::string &text)
     text += "\n";
     for (auto i = pars.begin(); i != pars.end(); i++)
     {
-        std::ostringstream ss;
-        gx_system::JsonWriter jw(&ss);
-        (*i)->serializeJSON(jw);
-
         text += "\n";
         if ((*i)->name() != "") text += "\"" + (*i)->name() + "\" ";
         /*else */text += (*i)->id();
@@ -627,19 +623,17 @@ void PluginEditor::getinfo(std::string &text)
 
 void PluginEditor::sliderValueChanged(juce::Slider* slider)
 {
-    gx_engine::ParamMap& param = ed->get_param();
-    const Glib::ustring& attr = slider->getComponentID().toStdString();
-    if (param.hasId(attr)) {
-        gx_engine::Parameter& p = param[attr];
+    gx_engine::Parameter *p = ed->get_parameter(slider->getComponentID().toRawUTF8());
+    if (p) {
         ed->SetAlternateDouble(ModifierKeys::getCurrentModifiers().testFlags(ModifierKeys::shiftModifier));
-        p.set_blocked(true);
-        if (p.isFloat()) {
-            p.getFloat().set(slider->getValue());
+        p->set_blocked(true);
+        if (p->isFloat()) {
+            p->getFloat().set(slider->getValue());
         }
-        else if (p.isInt()) {
-            p.getInt().set(slider->getValue());
+        else if (p->isInt()) {
+            p->getInt().set(slider->getValue());
         }
-        p.set_blocked(false);
+        p->set_blocked(false);
         ed->SetAlternateDouble(false);
         //save_state();
     }
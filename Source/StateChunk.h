@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** StateChunk - compact host state of the machines
+ *
+ *  A chunk starts with the magic "GXVS", a version and a flags
+ *  byte, the payload follows, gzip compressed when that pays.
+ *  f_macros marks chunks saved in macro mode, their host
+ *  automation addresses the macro slots instead of the
+ *  parameters.
+ *  The payload holds the number of machines, for each of them
+ *  the current preset, the mono and stereo rack unit order and
+ *  the savable parameters which differ from their default, in
+ *  the order of the parameter map. Numbers are stored binary,
+ *  string, JConv and sequencer values as their JSON. In macro
+ *  mode the slot bindings follow the machine sections, chunks
+ *  without them leave all slots unbound.
+ *
+ *  MachineState::read() parses a machine section without
+ *  touching the engine, apply() writes it to a machine and
+ *  resets all parameters which aren't in the section.
+ *
+ *  Chunks without the magic are the JSON state of older
+ *  versions and are handled by the caller.
+ *
+ *  usage:
+ *      juce::MemoryOutputStream payload;
+ *      payload.writeByte(1);
+ *      MachineState::write(payload, machine);
+ *      StateChunk::wrap(destData, payload, StateChunk::f_macros);
+ *
+ *      juce::MemoryBlock payload;
+ *      if (StateChunk::unwrap(data, size, payload)) {
+ *          juce::MemoryInputStream is(payload, false);
+ *          int n = is.readByte();
+ *          MachineState s;
+ *          if (s.read(is)) s.apply(machine);
+ *      }
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <JuceHeader.h>
+#include "guitarix.h"
+#include "ViewStreamBuf.h"
+
+namespace StateChunk
+{
+    static const char magic[4] = { 'G', 'X', 'V', 'S' };
+    enum { version = 1 };
+    enum { f_gzip = 1, f_macros = 2 };
+    // smaller payloads are stored as they are
+    enum { gzip_threshold = 1024 };
+
+    inline bool isChunk(const void *data, size_t size) {
+        return size >= 6 && memcmp(data, magic, 4) == 0;
+    }
+
+    // flags takes f_macros, f_gzip is set here
+    inline void wrap(juce::MemoryBlock& dest, const juce::MemoryOutputStream& payload, int flags = 0) {
+        juce::MemoryOutputStream os(dest, true);
+        os.write(magic, 4);
+        os.writeByte(version);
+        if (payload.getDataSize() < gzip_threshold) {
+            os.writeByte(char(flags));
+            os.write(payload.getData(), payload.getDataSize());
+            return;
+        }
+        os.writeByte(char(flags | f_gzip));
+        juce::GZIPCompressorOutputStream gz(os);
+        gz.write(payload.getData(), payload.getDataSize());
+    }
+
+    inline bool hasMacros(const void *data, size_t size) {
+        return isChunk(data, size) && (static_cast<const uint8_t*>(data)[5] & f_macros);
+    }
+
+    // false for chunks of a newer version or broken data
+    inline bool unwrap(const void *data, size_t size, juce::MemoryBlock& payload) {
+        if (!isChunk(data, size)) return false;
+        const uint8_t *d = static_cast<const uint8_t*>(data);
+        if (d[4] > version) return false;
+        if (!(d[5] & f_gzip)) {
+            payload.replaceAll(d + 6, size - 6);
+            return true;
+        }
+        juce::MemoryInputStream in(d + 6, size - 6, false);
+        juce::GZIPDecompressorInputStream gz(in);
+        payload.reset();
+        juce::MemoryOutputStream os(payload, false);
+        os.writeFromInputStream(gz, -1);
+        os.flush();
+        return payload.getSize() > 0;
+    }
+
+    // engine parameter ids of the macro slots, empty ids are unbound
+    inline void writeMacros(juce::OutputStream& os, const std::vector<std::string>& ids) {
+        int n = 0;
+        for (const auto& id : ids) if (!id.empty()) n++;
+        os.writeCompressedInt(n);
+        for (size_t slot = 0; slot < ids.size(); slot++) {
+            if (ids[slot].empty()) continue;
+            os.writeByte(char(slot));
+            os.writeString(juce::String::fromUTF8(ids[slot].c_str()));
+        }
+    }
+
+    // ids holds one entry per slot
+    inline void readMacros(juce::InputStream& is, std::vector<std::string>& ids) {
+        std::fill(ids.begin(), ids.end(), std::string());
+        if (is.isExhausted()) return;
+        const int n = is.readCompressedInt();
+        for (int i = 0; i < n && !is.isExhausted(); i++) {
+            const size_t slot = uint8_t(is.readByte());
+            std::string id = is.readString().toStdString();
+            if (slot < ids.size()) ids[slot] = std::move(id);
+        }
+    }
+}
+
+class MachineState
+{
+public:
+    std::string bank, preset;
+    std::vector<std::string> order[2];
+
+    static void write(juce::OutputStream& os, gx_engine::GxMachine *m) {
+        gx_preset::GxSettings& settings = m->get_settings();
+        const bool is_preset = settings.setting_is_preset();
+        os.writeString(is_preset ? juce::String::fromUTF8(settings.get_current_bank().c_str()) : juce::String());
+        os.writeString(is_preset ? juce::String::fromUTF8(settings.get_current_name().c_str()) : juce::String());
+        for (int stereo = 0; stereo < 2; stereo++) {
+            const std::vector<std::string> units = settings.get_rack_unit_order(stereo);
+            os.writeCompressedInt(int(units.size()));
+            for (const auto& unit : units) os.writeString(juce::String::fromUTF8(unit.c_str()));
+        }
+        gx_engine::ParamMap& pmap = settings.get_param();
+        juce::MemoryOutputStream values;
+        int n = 0;
+        for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
+            gx_engine::Parameter *p = i->second;
+            if (!p->isSavable() || p->isOutput()) continue;
+            const Kind kind = kindOf(p);
+            if (kind != k_json) {
+                p->stdJSON_value();
+                if (p->compareJSON_value()) continue;
+            }
+            values.writeString(juce::String::fromUTF8(p->id().c_str()));
+            values.writeByte(char(kind));
+            switch (kind) {
+            case k_float: values.writeFloat(p->getFloat().get_value()); break;
+            case k_int: values.writeInt(p->getInt().get_value()); break;
+            case k_bool: values.writeByte(p->getBool().get_value()); break;
+            case k_json: {
+                std::ostringstream js;
+                gx_system::JsonWriter jw(&js, false);
+                jw.begin_object();
+                p->writeJSON(jw);
+                jw.end_object();
+                jw.close();
+                const std::string s = js.str();
+                values.writeString(juce::String::fromUTF8(s.data(), int(s.size())));
+                break;
+            }
+            }
+            n++;
+        }
+        os.writeCompressedInt(n);
+        os << values;
+    }
+
+    bool read(juce::InputStream& is) {
+        bank = is.readString().toStdString();
+        preset = is.readString().toStdString();
+        for (int stereo = 0; stereo < 2; stereo++) {
+            const int n = is.readCompressedInt();
+            if (n < 0 || is.isExhausted()) return false;
+            order[stereo].clear();
+            for (int i = 0; i < n; i++) order[stereo].push_back(is.readString().toStdString());
+        }
+        const int n = is.readCompressedInt();
+        if (n < 0) return false;
+        entries.clear();
+        entries.reserve(n);
+        for (int i = 0; i < n; i++) {
+            if (is.isExhausted()) return false;
+            Entry e;
+            e.id = is.readString().toStdString();
+            e.kind = Kind(is.readByte());
+            e.i = 0;
+            switch (e.kind) {
+            case k_float: e.f = is.readFloat(); break;
+            case k_int: e.i = is.readInt(); break;
+            case k_bool: e.i = is.readByte(); break;
+            case k_json: e.json = is.readString().toStdString(); break;
+            default: return false;
+            }
+            entries.push_back(std::move(e));
+        }
+        return true;
+    }
+
+    // the caller loads the preset first, when it isn't the current one
+    void apply(gx_engine::GxMachine *m) const {
+        gx_preset::GxSettings& settings = m->get_settings();
+        gx_engine::ParamMap& pmap = settings.get_param();
+        // both lists are ordered by id
+        auto e = entries.begin();
+        for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
+            gx_engine::Parameter *p = i->second;
+            if (!p->isSavable() || p->isOutput()) continue;
+            while (e != entries.end() && e->id < i->first) ++e;
+            if (e != entries.end() && e->id == i->first && e->kind == kindOf(p)) {
+                switch (e->kind) {
+                case k_float: p->getFloat().set(e->f); break;
+                case k_int: p->getInt().set(e->i); break;
+                case k_bool: p->getBool().set(e->i != 0); break;
+                case k_json: {
+                    ViewStreamBuf buf(e->json.data(), e->json.size());
+                    std::istream js(&buf);
+                    gx_system::JsonParser jp(&js);
+                    jp.next(gx_system::JsonParser::begin_object);
+                    jp.next(gx_system::JsonParser::value_key);
+                    p->readJSON_value(jp);
+                    p->setJSON_value();
+                    break;
+                }
+                }
+            } else {
+                p->stdJSON_value();
+                p->setJSON_value();
+            }
+        }
+        for (int stereo = 0; stereo < 2; stereo++) {
+            const std::vector<std::string> current = settings.get_rack_unit_order(stereo);
+            if (current == order[stereo]) continue;
+            for (const auto& unit : current)
+                settings.remove_rack_unit(unit, stereo);
+            for (const auto& unit : order[stereo])
+                settings.insert_rack_unit(unit, "", stereo);
+            settings.signal_rack_unit_order_changed()(stereo);
+        }
+    }
+
+private:
+    enum Kind { k_float, k_int, k_bool, k_json };
+    struct Entry {
+        std::string id;
+        Kind kind;
+        float f;
+        int i;
+        std::string json;
+    };
+    std::vector<Entry> entries;
+
+    static Kind kindOf(gx_engine::Parameter *p) {
+        if (p->isFloat()) return k_float;
+        if (p->isInt()) return k_int;
+        if (p->isBool()) return k_bool;
+        return k_json;
+    }
+};
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Hermann Meyer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/****************************************************************
+ ** ViewStreamBuf - read only std::streambuf over a buffer
+ *
+ *  Feeds the parsers which take a std::istream from a buffer of
+ *  the caller, without copying it into a std::istringstream
+ *  first. The buffer must outlive the stream.
+ *
+ *  usage:
+ *      ViewStreamBuf buf(state.data(), state.size());
+ *      std::istream is(&buf);
+ *      gx_system::JsonParser jp(&is);
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <streambuf>
+
+class ViewStreamBuf : public std::streambuf
+{
+public:
+    ViewStreamBuf() {}
+    ViewStreamBuf(const char *data, size_t size) { reset(data, size); }
+
+    void reset(const char *data, size_t size) {
+        char *b = const_cast<char*>(data);
+        setg(b, b, b + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+        char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+        char *pos = base + off;
+        if (pos < eback() || pos > egptr()) return pos_type(off_type(-1));
+        setg(eback(), pos, egptr());
+        return pos_type(pos - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};